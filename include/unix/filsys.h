@@ -21,7 +21,9 @@ struct filsys {
     int8_t      s_fmod;         /* Superblock modified flag */
     int8_t      s_ronly;        /* Mounted read-only flag */
     time_t      s_time[2];      /* Current date of last update */
-    int16_t     pad[50];        /* Padding to 512 bytes */
+    daddr_t     s_jstart;       /* First block of journal region */
+    daddr_t     s_jsize;        /* Blocks in journal, 0 if none */
+    int16_t     pad[38];        /* Padding to 512 bytes */
 };
 
 /* Mount table entry */
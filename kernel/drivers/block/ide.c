@@ -34,12 +34,17 @@ extern void outw(uint16_t port, uint16_t val);
 /* Commands */
 #define ATA_CMD_READ    0x20
 #define ATA_CMD_WRITE   0x30
+#define ATA_CMD_IDENT   0xEC
 
 #define IDE_MAJOR       1
+#define IDE_MAXSECT     256     /* Sectors per command (count 0) */
 
 static struct devtab ide_tab;
 static int ide_present;
 
+/* Size of the disk in blocks, 0 if there is none */
+daddr_t ide_nblock;
+
 static int ide_wait_ready(void) {
     for (int i = 0; i < 100000; i++) {
         uint8_t st = inb(ATA_STATUS);
@@ -63,12 +68,12 @@ static int ide_wait_drq(void) {
     return -1;
 }
 
-static int ide_select_lba(uint32_t lba) {
+static int ide_select_lba(uint32_t lba, int nsect) {
     if (ide_wait_ready() != 0) {
         return -1;
     }
     outb(ATA_HDDEVSEL, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_SECCNT, 1);
+    outb(ATA_SECCNT, nsect & 0xFF);
     outb(ATA_LBA0, lba & 0xFF);
     outb(ATA_LBA1, (lba >> 8) & 0xFF);
     outb(ATA_LBA2, (lba >> 16) & 0xFF);
@@ -91,6 +96,7 @@ static int ide_strategy(struct buf *bp) {
     uint32_t lba = bp->b_blkno;
     int count = (-bp->b_wcount) * 2;
     char *addr = bp->b_addr;
+    int n;
 
     if (!ide_present) {
         bp->b_flags |= B_ERROR;
@@ -106,40 +112,43 @@ static int ide_strategy(struct buf *bp) {
         return -1;
     }
 
-    for (int off = 0; off < count; off += BSIZE, lba++) {
-        if (ide_select_lba(lba) != 0) {
+    /*
+     * Up to IDE_MAXSECT sectors go in one command; the drive
+     * raises DRQ for each sector in turn.
+     */
+    for (int off = 0; off < count; off += n * BSIZE, lba += n) {
+        n = (count - off) / BSIZE;
+        if (n > IDE_MAXSECT) {
+            n = IDE_MAXSECT;
+        }
+        if (ide_select_lba(lba, n) != 0) {
             bp->b_flags |= B_ERROR;
             bp->b_error = EIO;
             break;
         }
 
-        if (bp->b_flags & B_READ) {
-            outb(ATA_COMMAND, ATA_CMD_READ);
-            if (ide_wait_drq() != 0) {
-                bp->b_flags |= B_ERROR;
-                bp->b_error = EIO;
-                break;
-            }
-            for (int i = 0; i < BSIZE / 2; i++) {
-                uint16_t w = inw(ATA_DATA);
-                addr[off + i * 2] = w & 0xFF;
-                addr[off + i * 2 + 1] = (w >> 8) & 0xFF;
-            }
-        } else {
-            outb(ATA_COMMAND, ATA_CMD_WRITE);
+        outb(ATA_COMMAND, (bp->b_flags & B_READ) ? ATA_CMD_READ : ATA_CMD_WRITE);
+        for (int s = 0; s < n; s++) {
+            uint16_t *wp = (uint16_t *)(addr + off + s * BSIZE);
+
             if (ide_wait_drq() != 0) {
                 bp->b_flags |= B_ERROR;
                 bp->b_error = EIO;
-                break;
+                goto done;
             }
-            for (int i = 0; i < BSIZE / 2; i++) {
-                uint16_t w = (uint16_t)(uint8_t)addr[off + i * 2] |
-                             ((uint16_t)(uint8_t)addr[off + i * 2 + 1] << 8);
-                outw(ATA_DATA, w);
+            if (bp->b_flags & B_READ) {
+                for (int i = 0; i < BSIZE / 2; i++) {
+                    wp[i] = inw(ATA_DATA);
+                }
+            } else {
+                for (int i = 0; i < BSIZE / 2; i++) {
+                    outw(ATA_DATA, wp[i]);
+                }
             }
         }
     }
 
+done:
     bp->b_resid = 0;
     iodone(bp);
     return 0;
@@ -163,6 +172,19 @@ void ide_init(void) {
     }
 
     ide_present = 1;
+
+    /* IDENTIFY words 60-61 give the LBA28 sector count */
+    outb(ATA_HDDEVSEL, 0xA0);
+    outb(ATA_COMMAND, ATA_CMD_IDENT);
+    if (inb(ATA_STATUS) != 0 && ide_wait_drq() == 0) {
+        uint16_t id[256];
+
+        for (int i = 0; i < 256; i++) {
+            id[i] = inw(ATA_DATA);
+        }
+        ide_nblock = id[60] | ((uint32_t)id[61] << 16);
+    }
+
     bdevsw[IDE_MAJOR] = ide_bdevsw;
     if (nblkdev <= IDE_MAJOR) {
         nblkdev = IDE_MAJOR + 1;
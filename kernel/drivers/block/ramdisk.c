@@ -21,6 +21,9 @@
 #define RAMDISK_SIZE    (8 * 1024 * 1024)
 #define RAMDISK_BLOCKS  (RAMDISK_SIZE / BSIZE)
 
+/* Journal region at the end of the disk */
+#define RAMDISK_JBLOCKS 64
+
 /* RAM disk storage */
 static char ramdisk[RAMDISK_SIZE];
 
@@ -298,7 +301,9 @@ static void rd_mkfs(void) {
     int data_block = 2 + inode_blocks;
 
     fp->s_isize = inode_blocks;
-    fp->s_fsize = RAMDISK_BLOCKS;
+    fp->s_fsize = RAMDISK_BLOCKS - RAMDISK_JBLOCKS;
+    fp->s_jstart = fp->s_fsize;
+    fp->s_jsize = RAMDISK_JBLOCKS;
     fp->s_nfree = 0;
     fp->s_ninode = 0;
     fp->s_flock = 0;
@@ -809,7 +814,7 @@ static void rd_mkfs(void) {
     rd_write_dir(dip[ino_sbin - 1].i_addr[0], sbin_dir, sbin_cnt);
 
     int nfree = 0;
-    for (daddr_t b = data_block; b < RAMDISK_BLOCKS && nfree < NICFREE; b++) {
+    for (daddr_t b = data_block; b < fp->s_fsize && nfree < NICFREE; b++) {
         fp->s_free[nfree++] = b;
     }
     fp->s_nfree = nfree;
@@ -14,6 +14,7 @@
 #include "include/buf.h"
 #include "include/inode.h"
 #include "include/conf.h"
+#include "include/journal.h"
 
 /* External declarations */
 extern struct user u;
@@ -80,9 +81,13 @@ void iinit(void) {
     /* Set up mount table entry for root */
     mount[0].m_bufp = cp;
     mount[0].m_dev = rootdev;
+    mount[0].m_flags = MNT_RELATIME;   /* Root cannot be remounted */
     
-    /* Initialize superblock fields */
+    /* Replay the journal, if any, before trusting the superblock */
     fp = (struct filsys *)cp->b_addr;
+    jinit(rootdev, fp);
+    
+    /* Initialize superblock fields */
     fp->s_flock = 0;
     fp->s_ilock = 0;
     fp->s_ronly = 0;
@@ -112,6 +117,7 @@ struct buf *alloc(dev_t dev) {
         u.u_error = ENODEV;
         return NULL;
     }
+    jbegin(dev);
     
     /* Wait if free list is locked */
     while (fp->s_flock) {
@@ -140,18 +146,74 @@ struct buf *alloc(dev_t dev) {
         wakeup(&fp->s_flock);
     }
     
+    jrevoke(dev, bno);
     bp = getblk(dev, bno);
     clrbuf(bp);
     fp->s_fmod = 1;
+    jend(dev);
     return bp;
 
 nospace:
     fp->s_nfree = 0;
     prdev("no space", dev);
     u.u_error = ENOSPC;
+    jend(dev);
     return NULL;
 }
 
+/*
+ * allocrun - Arrange for the next n allocations to be contiguous
+ *
+ * Finds the longest run of consecutive block numbers, up to n,
+ * in the in-core free list and moves it to the top, lowest
+ * block last, so that alloc hands it out in ascending order.
+ * Entry 0, which chains to the next batch, stays where it is.
+ */
+void allocrun(dev_t dev, int n) {
+    struct filsys *fp;
+    daddr_t best, b;
+    int bestlen, len, i, j;
+    
+    fp = getfs(dev);
+    if (fp == NULL || n < 2 || fp->s_flock) {
+        return;
+    }
+    
+    best = 0;
+    bestlen = 1;
+    for (i = 1; i < fp->s_nfree; i++) {
+        for (len = 1; len < n; len++) {
+            for (j = 1; j < fp->s_nfree; j++) {
+                if (fp->s_free[j] == fp->s_free[i] + len) {
+                    break;
+                }
+            }
+            if (j == fp->s_nfree) {
+                break;
+            }
+        }
+        if (len > bestlen) {
+            best = fp->s_free[i];
+            bestlen = len;
+        }
+    }
+    if (bestlen < 2) {
+        return;
+    }
+    
+    j = 1;
+    for (i = 1; i < fp->s_nfree; i++) {
+        b = fp->s_free[i];
+        if (b < best || b >= best + bestlen) {
+            fp->s_free[j++] = b;
+        }
+    }
+    for (b = best + bestlen - 1; b >= best; b--) {
+        fp->s_free[j++] = b;
+    }
+    fp->s_fmod = 1;
+}
+
 /*
  * free - Place a disk block back on the free list
  */
@@ -189,7 +251,9 @@ void bfree(dev_t dev, daddr_t bno) {
         *ip++ = fp->s_nfree;
         bcopy(fp->s_free, ip, sizeof(fp->s_free));
         fp->s_nfree = 0;
-        bwrite(bp);
+        if (!jlog(bp)) {
+            bwrite(bp);
+        }
         fp->s_flock = 0;
         wakeup(&fp->s_flock);
     }
@@ -231,6 +295,7 @@ struct inode *ialloc(dev_t dev) {
         u.u_error = ENODEV;
         return NULL;
     }
+    jbegin(dev);
     
     while (fp->s_ilock) {
         sleep(&fp->s_ilock, PINOD);
@@ -241,6 +306,7 @@ loop:
         ino = fp->s_inode[--fp->s_ninode];
         ip = iget(dev, ino);
         if (ip == NULL) {
+            jend(dev);
             return NULL;
         }
         if (ip->i_mode == 0) {
@@ -259,6 +325,7 @@ loop:
             ip->i_mtime = time[1];
             ip->i_ctime = time[1];
             fp->s_fmod = 1;
+            jend(dev);
             return ip;
         }
         /* Inode was allocated after all, try again */
@@ -311,6 +378,7 @@ loop:
     
     prdev("Out of inodes", dev);
     u.u_error = ENOSPC;
+    jend(dev);
     return NULL;
 }
 
@@ -367,14 +435,13 @@ struct filsys *getfs(dev_t dev) {
 /*
  * update - Sync all filesystems (internal implementation of 'sync')
  * Goes through disk queues to initiate I/O, writes modified inodes,
- * and writes modified superblocks.
+ * and writes modified superblocks.  A journaled file system's
+ * superblock and inodes go out in one commit to its log.
  */
 void update(void) {
-    struct inode *ip;
     struct mount *mp;
     struct buf *bp;
     struct filsys *fp;
-    int i;
     
     if (updlock) {
         return;
@@ -389,7 +456,7 @@ void update(void) {
         
         fp = (struct filsys *)mp->m_bufp->b_addr;
         if (fp->s_fmod == 0 || fp->s_ilock != 0 || 
-            fp->s_flock != 0 || fp->s_ronly != 0) {
+            fp->s_flock != 0 || fp->s_ronly != 0 || jfind(mp->m_dev)) {
             continue;
         }
         
@@ -401,14 +468,12 @@ void update(void) {
         bwrite(bp);
     }
     
-    /* Write out modified inodes */
-    for (i = 0; i < NINODE; i++) {
-        ip = &inode[i];
-        if ((ip->i_flag & (ILOCK | IUPD)) == IUPD) {
-            ip->i_flag |= ILOCK;
-            ip->i_flag &= ~IUPD;
-            iupdat(ip, time);
-            prele(ip);
+    /* Write out modified inodes, a block at a time */
+    iflush(NODEV);
+    
+    for (mp = &mount[0]; mp < &mount[NMOUNT]; mp++) {
+        if (mp->m_bufp != NULL) {
+            jcommit(mp->m_dev);
         }
     }
     
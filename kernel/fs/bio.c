@@ -13,6 +13,8 @@
 #include "include/conf.h"
 #include "include/systm.h"
 #include "include/proc.h"
+#include "include/inode.h"
+#include "include/journal.h"
 
 /* External declarations */
 extern struct buf buf[];
@@ -25,6 +27,12 @@ extern void kprintf(const char *fmt, ...);
 extern void sleep(void *chan, int pri);
 extern void wakeup(void *chan);
 extern int nblkdev;  /* Defined in main.c */
+extern daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg);
+extern void allocrun(dev_t dev, int n);
+extern void plock(struct inode *ip);
+
+/* Buffers holding delayed-allocation data */
+static int ndalloc;
 
 /*
  * Read in (if necessary) the block and return a buffer pointer.
@@ -57,7 +65,7 @@ struct buf *bread(dev_t dev, daddr_t blkno) {
  * read-ahead block (which is not allocated to the caller)
  */
 struct buf *breada(dev_t dev, daddr_t blkno, daddr_t rablkno) {
-    struct buf *bp, *rabp;
+    struct buf *bp;
     
     bp = NULL;
     
@@ -72,17 +80,8 @@ struct buf *breada(dev_t dev, daddr_t blkno, daddr_t rablkno) {
         }
     }
     
-    if (rablkno && !incore(dev, rablkno)) {
-        rabp = getblk(dev, rablkno);
-        if (rabp->b_flags & B_DONE) {
-            brelse(rabp);
-        } else {
-            rabp->b_flags |= B_READ | B_ASYNC;
-            rabp->b_wcount = -(BSIZE / 2);
-            if (bdevsw[major(dev)].d_strategy) {
-                (*bdevsw[major(dev)].d_strategy)(rabp);
-            }
-        }
+    if (rablkno) {
+        bprefetch(dev, rablkno);
     }
     
     if (bp == NULL) {
@@ -93,6 +92,58 @@ struct buf *breada(dev_t dev, daddr_t blkno, daddr_t rablkno) {
     return bp;
 }
 
+/*
+ * Start an asynchronous read of a block that is not in
+ * the cache.  Returns 1 if a read was started.
+ */
+int bprefetch(dev_t dev, daddr_t blkno) {
+    struct buf *bp;
+    
+    if (incore(dev, blkno)) {
+        return 0;
+    }
+    bp = getblk(dev, blkno);
+    if (bp->b_flags & B_DONE) {
+        brelse(bp);
+        return 0;
+    }
+    bp->b_flags |= B_READ | B_ASYNC;
+    bp->b_wcount = -(BSIZE / 2);
+    if (bdevsw[major(dev)].d_strategy) {
+        (*bdevsw[major(dev)].d_strategy)(bp);
+    }
+    return 1;
+}
+
+/*
+ * Forget a cached block that is clean and not in use, and
+ * put its buffer first in line to be reused.
+ */
+void bforget(dev_t dev, daddr_t blkno) {
+    struct buf *bp;
+    int s;
+    
+    extern int spl6(void);
+    extern void splx(int);
+    
+    bp = incore(dev, blkno);
+    if (bp == NULL) {
+        return;
+    }
+    s = spl6();
+    if ((bp->b_flags & (B_BUSY | B_DELWRI | B_JLOG | B_DELALLOC)) == 0) {
+        bp->b_dev = NODEV;
+        bp->b_flags &= ~B_DONE;
+        bp->av_back->av_forw = bp->av_forw;
+        bp->av_forw->av_back = bp->av_back;
+        bp->av_forw = bfreelist.av_forw;
+        bp->av_back = &bfreelist;
+        bfreelist.av_forw->av_back = bp;
+        bfreelist.av_forw = bp;
+    }
+    splx(s);
+}
+
 /*
  * Write the buffer, waiting for completion.
  * Then release the buffer.
@@ -250,7 +301,33 @@ loop:
     }
     spl0();
     
-    bp = bfreelist.av_forw;
+    /*
+     * Blocks held for the journal stay until their transaction
+     * commits; file data waiting for a block, while its file is
+     * locked by the process writing it.
+     */
+    for (bp = bfreelist.av_forw; bp != &bfreelist; bp = bp->av_forw) {
+        if ((bp->b_flags & B_JLOG) == 0 &&
+            ((bp->b_flags & B_DELALLOC) == 0 || (bp->b_ip->i_flag & ILOCK) == 0)) {
+            break;
+        }
+    }
+    if (bp == &bfreelist) {
+        if (jflush() == 0) {
+            /* Every held block is in an operation still running */
+            spl6();
+            bfreelist.b_flags |= B_WANTED;
+            sleep(&bfreelist, PRIBIO);
+            spl0();
+        }
+        goto loop;
+    }
+    
+    /* File data waiting for a block gets it now, with the rest of its file */
+    if (bp->b_flags & B_DELALLOC) {
+        dtryalloc(bp->b_ip);
+        goto loop;
+    }
     notavail(bp);
     
     /* Write out delayed-write blocks */
@@ -261,6 +338,7 @@ loop:
     }
     
     bp->b_flags = B_BUSY;
+    bdisown(bp);
     
     /* Remove from old device list */
     bp->b_back->b_forw = bp->b_forw;
@@ -344,7 +422,9 @@ void clrbuf(struct buf *bp) {
 
 /*
  * Make sure all write-behind blocks on dev (or NODEV for all)
- * are flushed out.
+ * are flushed out.  Delayed-allocation data is given its
+ * blocks first.  Blocks held for the journal are left until
+ * their transaction commits.
  */
 void bflush(dev_t dev) {
     struct buf *bp;
@@ -352,10 +432,18 @@ void bflush(dev_t dev) {
     extern int spl6(void);
     extern int spl0(void);
 
+    for (bp = &buf[0]; bp < &buf[NBUF]; bp++) {
+        if ((bp->b_flags & (B_DELALLOC | B_BUSY)) == B_DELALLOC &&
+            (dev == NODEV || bp->b_ip->i_dev == dev)) {
+            dtryalloc(bp->b_ip);
+        }
+    }
+
 loop:
     spl6();
     for (bp = bfreelist.av_forw; bp != &bfreelist; bp = bp->av_forw) {
-        if ((bp->b_flags & B_DELWRI) && (dev == NODEV || bp->b_dev == dev)) {
+        if ((bp->b_flags & (B_DELWRI | B_JLOG | B_DELALLOC)) == B_DELWRI &&
+            (dev == NODEV || bp->b_dev == dev)) {
             bp->b_flags |= B_ASYNC;
             notavail(bp);
             bwrite(bp);
@@ -365,6 +453,339 @@ loop:
     spl0();
 }
 
+/*
+ * Give a buffer the identity of a disk block.  Any other
+ * buffer still holding the block is stale and is dropped.
+ */
+void bassign(struct buf *bp, dev_t dev, daddr_t blkno) {
+    struct buf *zp;
+    struct devtab *dp;
+    
+    extern int spl6(void);
+    extern int spl0(void);
+
+loop:
+    zp = incore(dev, blkno);
+    if (zp != NULL) {
+        spl6();
+        if (zp->b_flags & B_BUSY) {
+            zp->b_flags |= B_WANTED;
+            sleep(zp, PRIBIO);
+            spl0();
+            goto loop;
+        }
+        spl0();
+        notavail(zp);
+        zp->b_flags = B_BUSY;
+        bdisown(zp);
+        zp->b_back->b_forw = zp->b_forw;
+        zp->b_forw->b_back = zp->b_back;
+        zp->b_forw = zp;
+        zp->b_back = zp;
+        zp->b_dev = NODEV;
+        brelse(zp);
+    }
+    
+    dp = bdevsw[major(dev)].d_tab;
+    bp->b_back->b_forw = bp->b_forw;
+    bp->b_forw->b_back = bp->b_back;
+    bp->b_forw = dp->b_forw;
+    bp->b_back = (struct buf *)dp;
+    dp->b_forw->b_back = bp;
+    dp->b_forw = bp;
+    bp->b_dev = dev;
+    bp->b_blkno = blkno;
+}
+
+/*
+ * Delayed allocation.
+ *
+ * Data written past the blocks a regular file owns is kept
+ * in buffers named by inode and logical block (B_DELALLOC),
+ * with no disk block behind them.  Blocks are handed out only
+ * when such a buffer must be written, and then to all of the
+ * file's waiting buffers at once in logical order, so a file
+ * written a little at a time, or alongside other files, is
+ * still laid out contiguously.
+ */
+
+/*
+ * Find the delayed-allocation buffer for a logical block of
+ * a file and return it busy, or NULL if there is none.
+ */
+struct buf *dafind(struct inode *ip, daddr_t lbn) {
+    struct buf *bp;
+    
+    extern int spl6(void);
+    extern int spl0(void);
+
+loop:
+    for (bp = ip->i_dirtyb; bp != NULL; bp = bp->b_dnext) {
+        if ((bp->b_flags & B_DELALLOC) == 0 || bp->b_blkno != lbn) {
+            continue;
+        }
+        spl6();
+        if (bp->b_flags & B_BUSY) {
+            bp->b_flags |= B_WANTED;
+            sleep(bp, PRIBIO);
+            spl0();
+            goto loop;
+        }
+        spl0();
+        notavail(bp);
+        return bp;
+    }
+    return NULL;
+}
+
+/*
+ * Get a delayed-allocation buffer for a logical block of a
+ * file.  A new one is not marked done.  Returns NULL when too
+ * many are outstanding; the caller then allocates at once.
+ */
+struct buf *dagetblk(struct inode *ip, daddr_t lbn) {
+    struct buf *bp;
+
+    bp = dafind(ip, lbn);
+    if (bp != NULL) {
+        return bp;
+    }
+    if (ndalloc >= NDALLOC) {
+        dalloc(ip);
+        if (ndalloc >= NDALLOC) {
+            return NULL;
+        }
+    }
+    bp = getblk(NODEV, 0);
+    bp->b_flags |= B_DELALLOC;
+    bp->b_blkno = lbn;
+    bown(bp, ip);
+    ndalloc++;
+    return bp;
+}
+
+/*
+ * Allocate disk blocks for all of a file's delayed-allocation
+ * buffers, which become ordinary delayed writes still owned
+ * by the file.  The caller holds the inode locked.
+ */
+void dalloc(struct inode *ip) {
+    struct buf *list[NDALLOC];
+    struct buf *bp;
+    daddr_t bn;
+    int i, n;
+
+    /* Take them off the free list, sorted by logical block */
+    n = 0;
+    for (bp = ip->i_dirtyb; bp != NULL && n < NDALLOC; bp = bp->b_dnext) {
+        if ((bp->b_flags & (B_DELALLOC | B_BUSY)) != B_DELALLOC) {
+            continue;
+        }
+        notavail(bp);
+        for (i = n++; i > 0 && list[i - 1]->b_blkno > bp->b_blkno; i--) {
+            list[i] = list[i - 1];
+        }
+        list[i] = bp;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    allocrun(ip->i_dev, n);
+    for (i = 0; i < n; i++) {
+        bp = list[i];
+
+        /* Each block may log two indirect blocks; the inode closes a split */
+        if (!jroom(ip->i_dev, 3)) {
+            ip->i_flag |= IUPD;
+            iupdat(ip, time);
+            jrestart(ip->i_dev);
+        }
+        bn = bmap(ip, bp->b_blkno, 1);
+        bp->b_flags &= ~B_DELALLOC;
+        ndalloc--;
+        if (bn == 0 || bn == (daddr_t)-1) {
+            /* No space: the data is lost, as a failed write would be */
+            bp->b_flags &= ~B_DONE;
+            bdisown(bp);
+            brelse(bp);
+            continue;
+        }
+        bassign(bp, ip->i_dev, bn);
+        bdwrite(bp);
+    }
+}
+
+/*
+ * dalloc on behalf of someone other than the file's writer
+ * (getblk, bflush): skipped if the inode is locked, since
+ * its owner may be in bmap, or if we are in a journal
+ * operation, which the allocation would be counted in.  Running out of space is kept in
+ * i_error for the owner's next write or fsync, not left in
+ * the caller's u_error.  Returns 0 if skipped.
+ */
+int dtryalloc(struct inode *ip) {
+    int e;
+
+    if ((ip->i_flag & ILOCK) || jactive()) {
+        return 0;
+    }
+    ip->i_flag |= ILOCK;
+    e = u.u_error;
+    u.u_error = 0;
+    dalloc(ip);
+    if (u.u_error) {
+        ip->i_error = u.u_error;
+    }
+    u.u_error = e;
+    prele(ip);
+    return 1;
+}
+
+/*
+ * Throw away a file's delayed-allocation buffers (truncation).
+ */
+void dinval(struct inode *ip) {
+    struct buf *bp;
+    
+    extern int spl6(void);
+    extern int spl0(void);
+
+loop:
+    for (bp = ip->i_dirtyb; bp != NULL; bp = bp->b_dnext) {
+        if ((bp->b_flags & B_DELALLOC) == 0) {
+            continue;
+        }
+        spl6();
+        if (bp->b_flags & B_BUSY) {
+            bp->b_flags |= B_WANTED;
+            sleep(bp, PRIBIO);
+            spl0();
+            goto loop;
+        }
+        spl0();
+        notavail(bp);
+        bp->b_flags = B_BUSY;
+        bdisown(bp);
+        ndalloc--;
+        brelse(bp);
+        goto loop;
+    }
+}
+
+/*
+ * Dirty lists.
+ *
+ * Each in-core inode heads a list, through b_dnext, of the
+ * buffers holding its data and indirect blocks that may still
+ * have to be written, so fsync can write just those.  A buffer
+ * stays on the list after it is written and is dropped when
+ * the list is next searched or the buffer is reused.
+ */
+
+/*
+ * Put a buffer on a file's dirty list.
+ */
+void bown(struct buf *bp, struct inode *ip) {
+    if (bp->b_ip == ip) {
+        return;
+    }
+    bdisown(bp);
+    bp->b_ip = ip;
+    bp->b_dnext = ip->i_dirtyb;
+    ip->i_dirtyb = bp;
+}
+
+/*
+ * Take a buffer off its file's dirty list, if it is on one.
+ */
+void bdisown(struct buf *bp) {
+    struct buf **pp;
+
+    if (bp->b_ip == NULL) {
+        return;
+    }
+    for (pp = &bp->b_ip->i_dirtyb; *pp != NULL; pp = &(*pp)->b_dnext) {
+        if (*pp == bp) {
+            *pp = bp->b_dnext;
+            break;
+        }
+    }
+    bp->b_ip = NULL;
+    bp->b_dnext = NULL;
+}
+
+/*
+ * Empty a file's dirty list before its inode slot is reused.
+ * The buffers are left to be written in the usual way.
+ */
+void bdetach(struct inode *ip) {
+    struct buf *bp;
+
+    while ((bp = ip->i_dirtyb) != NULL) {
+        ip->i_dirtyb = bp->b_dnext;
+        bp->b_ip = NULL;
+        bp->b_dnext = NULL;
+    }
+}
+
+/*
+ * Write all of a file's dirty blocks and wait for them.
+ * The inode must not be locked by the caller.
+ * Delayed-allocation data gets its blocks first.  Blocks
+ * held for the journal are left to the caller's commit.
+ */
+void bsyncip(struct inode *ip) {
+    struct buf *list[NBUF];
+    struct buf *bp;
+    int i, n;
+    
+    extern int spl6(void);
+    extern int spl0(void);
+
+    plock(ip);
+    dalloc(ip);
+    prele(ip);
+    n = 0;
+loop:
+    for (bp = ip->i_dirtyb; bp != NULL; bp = bp->b_dnext) {
+        if (bp->b_flags & (B_JLOG | B_DELALLOC)) {
+            continue;
+        }
+        spl6();
+        if (bp->b_flags & B_BUSY) {
+            bp->b_flags |= B_WANTED;
+            sleep(bp, PRIBIO);
+            spl0();
+            goto loop;
+        }
+        spl0();
+        if ((bp->b_flags & B_DELWRI) == 0) {
+            /* Already written */
+            bdisown(bp);
+            goto loop;
+        }
+
+        /* Start the write now, wait for all of them below */
+        notavail(bp);
+        bdisown(bp);
+        bp->b_flags &= ~(B_READ | B_DONE | B_ERROR | B_DELWRI | B_ASYNC);
+        bp->b_wcount = -(BSIZE / 2);
+        if (bdevsw[major(bp->b_dev)].d_strategy) {
+            (*bdevsw[major(bp->b_dev)].d_strategy)(bp);
+        } else {
+            bp->b_flags |= B_DONE | B_ERROR;
+        }
+        list[n++] = bp;
+        goto loop;
+    }
+
+    for (i = 0; i < n; i++) {
+        iowait(list[i]);
+        brelse(list[i]);
+    }
+}
+
 /*
  * Pick up the device's error number and pass it to the user.
  */
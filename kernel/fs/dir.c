@@ -0,0 +1,691 @@
+/* dir.c - Unix V6 x86 Port Hashed Directories
+ * Directories with variable length names and a hashed index
+ *
+ * A directory is either a classic V6 array of 16-byte entries
+ * or a hashed directory (see filsys.h).  The routines here hide
+ * the difference from namei, wdir and the directory syscalls.
+ *
+ * x86 port: Unix V6 Modernization Project
+ */
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/user.h"
+#include "include/systm.h"
+#include "include/inode.h"
+#include "include/buf.h"
+#include "include/filsys.h"
+#include "include/journal.h"
+
+/* External declarations */
+extern struct user u;
+extern time_t time[];
+extern struct buf *bread(dev_t dev, daddr_t blkno);
+extern void brelse(struct buf *bp);
+extern void bdwrite(struct buf *bp);
+extern void clrbuf(struct buf *bp);
+extern daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg);
+extern void writei(struct inode *ip);
+extern void bcopy(const void *src, void *dst, int count);
+
+/*
+ * dirsize - Get directory size as a single 32-bit value
+ */
+static uint32_t dirsize(struct inode *dp) {
+    return ((uint32_t)(dp->i_size0 & 0xFF) << 16) | dp->i_size1;
+}
+
+/*
+ * dxwrite - Release a modified directory block
+ * Directory blocks are metadata and go through the journal.
+ */
+static void dxwrite(struct buf *bp) {
+    if (!jlog(bp)) {
+        bdwrite(bp);
+    }
+}
+
+/*
+ * dxhash - Hash a name into one of nbucket buckets
+ */
+static int dxhash(const char *cp, int n, int nbucket) {
+    uint32_t h;
+
+    h = 0;
+    while (n-- > 0) {
+        h = h * 31 + (*cp++ & 0xFF);
+    }
+    return h % nbucket;
+}
+
+/*
+ * dxtype - Directory entry type for an inode
+ */
+static int dxtype(struct inode *ip) {
+    switch (ip->i_mode & IFMT) {
+    case IFDIR:
+        return DT_DIR;
+    case IFCHR:
+        return DT_CHR;
+    case IFBLK:
+        return DT_BLK;
+    }
+    return DT_REG;
+}
+
+/*
+ * dxread - Read logical block lbn of a directory
+ */
+static struct buf *dxread(struct inode *dp, int lbn) {
+    struct buf *bp;
+    daddr_t bn;
+
+    bn = bmap(dp, lbn, 0);
+    if (bn == 0 || bn == (daddr_t)-1) {
+        u.u_error = EIO;
+        return NULL;
+    }
+    bp = bread(dp->i_dev, bn);
+    if (bp == NULL || (bp->b_flags & B_ERROR)) {
+        if (bp) brelse(bp);
+        u.u_error = EIO;
+        return NULL;
+    }
+    return bp;
+}
+
+/*
+ * dxgrow - Allocate logical block lbn of a directory
+ *
+ * The new block is returned cleared, as an empty leaf.
+ */
+static struct buf *dxgrow(struct inode *dp, int lbn) {
+    struct buf *bp;
+    struct ldirect *ep;
+    daddr_t bn;
+
+    bn = bmap(dp, lbn, 1);
+    if (bn == 0 || bn == (daddr_t)-1) {
+        if (u.u_error == 0)
+            u.u_error = ENOSPC;
+        return NULL;
+    }
+    bp = bread(dp->i_dev, bn);
+    if (bp == NULL || (bp->b_flags & B_ERROR)) {
+        if (bp) brelse(bp);
+        u.u_error = EIO;
+        return NULL;
+    }
+    clrbuf(bp);
+    ep = (struct ldirect *)(bp->b_addr + sizeof(struct dxleaf));
+    ep->d_reclen = BSIZE - sizeof(struct dxleaf);
+
+    if ((uint32_t)(lbn + 1) * BSIZE > dirsize(dp)) {
+        dp->i_size0 = (((lbn + 1) * BSIZE) >> 16) & 0xFF;
+        dp->i_size1 = ((lbn + 1) * BSIZE) & 0xFFFF;
+    }
+    dp->i_flag |= IUPD;
+    return bp;
+}
+
+/*
+ * dxroom - Find an entry in a leaf with need bytes to spare
+ *
+ * Returns the entry's offset in the block, or -1.
+ */
+static int dxroom(struct buf *bp, int need) {
+    struct ldirect *ep;
+    int o, used;
+
+    for (o = sizeof(struct dxleaf); o < BSIZE; o += ep->d_reclen) {
+        ep = (struct ldirect *)(bp->b_addr + o);
+        if (ep->d_reclen < LDIRHDR || o + ep->d_reclen > BSIZE)
+            return -1;
+        used = ep->d_ino ? LDIRSIZ(ep->d_namlen) : 0;
+        if (ep->d_reclen - used >= need)
+            return o;
+    }
+    return -1;
+}
+
+/*
+ * dxput - Place a name in the entry at offset o of a leaf
+ *
+ * A live entry is cut down to its own size and the new
+ * name goes in the space left over.
+ */
+static void dxput(struct buf *bp, int o, ino_t ino, int type,
+                  const char *name, int namlen) {
+    struct ldirect *ep, *np;
+    int used;
+
+    ep = (struct ldirect *)(bp->b_addr + o);
+    if (ep->d_ino) {
+        used = LDIRSIZ(ep->d_namlen);
+        np = (struct ldirect *)((char *)ep + used);
+        np->d_reclen = ep->d_reclen - used;
+        ep->d_reclen = used;
+        ep = np;
+    }
+    ep->d_ino = ino;
+    ep->d_namlen = namlen;
+    ep->d_type = type;
+    bcopy(name, ep->d_name, namlen);
+}
+
+/*
+ * dxsplit - Move the names hashing at or above mid to a new leaf
+ *
+ * The names that stay are packed to the front of the old leaf.
+ */
+static void dxsplit(struct buf *obp, struct buf *nbp, int nbucket, int mid) {
+    struct ldirect *ep, *lp;
+    int o, w, last, reclen, len;
+
+    w = sizeof(struct dxleaf);
+    last = -1;
+    for (o = sizeof(struct dxleaf); o < BSIZE; o += reclen) {
+        ep = (struct ldirect *)(obp->b_addr + o);
+        reclen = ep->d_reclen;
+        if (reclen < LDIRHDR || o + reclen > BSIZE)
+            break;
+        if (ep->d_ino == 0)
+            continue;
+        len = LDIRSIZ(ep->d_namlen);
+        if (dxhash(ep->d_name, ep->d_namlen, nbucket) >= mid) {
+            dxput(nbp, dxroom(nbp, len), ep->d_ino, ep->d_type,
+                  ep->d_name, ep->d_namlen);
+            continue;
+        }
+        if (w != o)
+            bcopy(ep, obp->b_addr + w, len);
+        lp = (struct ldirect *)(obp->b_addr + w);
+        lp->d_reclen = len;
+        last = w;
+        w += len;
+    }
+
+    if (last < 0) {
+        lp = (struct ldirect *)(obp->b_addr + sizeof(struct dxleaf));
+        lp->d_ino = 0;
+        last = sizeof(struct dxleaf);
+    } else {
+        lp = (struct ldirect *)(obp->b_addr + last);
+    }
+    lp->d_reclen = BSIZE - last;
+}
+
+/*
+ * dxmatch - Compare a leaf entry with a name
+ */
+static int dxmatch(struct ldirect *ep, const char *name, int namlen) {
+    int i;
+
+    if (ep->d_ino == 0 || ep->d_namlen != namlen)
+        return 0;
+    for (i = 0; i < namlen; i++) {
+        if (ep->d_name[i] != name[i])
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * dxisdir - Is dp a hashed directory?
+ */
+int dxisdir(struct inode *dp) {
+    struct buf *bp;
+    struct dxhead *hp;
+    daddr_t bn;
+    int r;
+
+    if ((dp->i_mode & IFMT) != IFDIR || dirsize(dp) < 2 * BSIZE)
+        return 0;
+    bn = bmap(dp, 0, 0);
+    if (bn == 0 || bn == (daddr_t)-1)
+        return 0;
+    bp = bread(dp->i_dev, bn);
+    if (bp == NULL)
+        return 0;
+    hp = (struct dxhead *)bp->b_addr;
+    r = (bp->b_flags & B_ERROR) == 0 && hp->dh_zero == 0 &&
+        hp->dh_magic == DXMAGIC &&
+        hp->dh_nbucket > 0 && hp->dh_nbucket <= DXNBUCKET;
+    brelse(bp);
+    return r;
+}
+
+/*
+ * dxfind - Look up a name in a hashed directory
+ *
+ * Only the leaf chain for the name's bucket is read.
+ * Returns the inode number and sets *offp to the entry's
+ * byte offset, or returns 0 if the name is not there.
+ */
+static ino_t dxfind(struct inode *dp, const char *name, int namlen, off_t *offp) {
+    struct buf *bp;
+    struct dxhead *hp;
+    struct ldirect *ep;
+    int lbn, o;
+    ino_t ino;
+
+    bp = dxread(dp, 0);
+    if (bp == NULL)
+        return 0;
+    hp = (struct dxhead *)bp->b_addr;
+    lbn = hp->dh_bucket[dxhash(name, namlen, hp->dh_nbucket)];
+    brelse(bp);
+
+    while (lbn != 0) {
+        bp = dxread(dp, lbn);
+        if (bp == NULL)
+            return 0;
+        for (o = sizeof(struct dxleaf); o < BSIZE; o += ep->d_reclen) {
+            ep = (struct ldirect *)(bp->b_addr + o);
+            if (ep->d_reclen < LDIRHDR || o + ep->d_reclen > BSIZE)
+                break;
+            if (dxmatch(ep, name, namlen)) {
+                ino = ep->d_ino;
+                brelse(bp);
+                *offp = lbn * BSIZE + o;
+                return ino;
+            }
+        }
+        lbn = ((struct dxleaf *)bp->b_addr)->dl_next;
+        brelse(bp);
+    }
+    return 0;
+}
+
+/*
+ * dxlookup - Look up the name in u.u_dbuf in a hashed directory
+ *
+ * On success u.u_offset is left at the entry.
+ */
+ino_t dxlookup(struct inode *dp) {
+    off_t off;
+    ino_t ino;
+
+    ino = dxfind(dp, u.u_dbuf, u.u_namlen, &off);
+    if (ino) {
+        u.u_offset[0] = 0;
+        u.u_offset[1] = off;
+    }
+    return ino;
+}
+
+/*
+ * dxenter - Enter the name in u.u_dbuf for ip into dp
+ *
+ * When the name's leaf is full it is split, or when it
+ * serves a single bucket an overflow block is chained on.
+ */
+int dxenter(struct inode *dp, struct inode *ip) {
+    struct buf *hbp, *bp, *nbp;
+    struct dxhead *hp;
+    int b, lo, hi, mid, lbn, nlbn, need, o, i;
+
+    need = LDIRSIZ(u.u_namlen);
+again:
+    hbp = dxread(dp, 0);
+    if (hbp == NULL)
+        return -1;
+    hp = (struct dxhead *)hbp->b_addr;
+    b = dxhash(u.u_dbuf, u.u_namlen, hp->dh_nbucket);
+    lbn = hp->dh_bucket[b];
+
+    for (;;) {
+        bp = dxread(dp, lbn);
+        if (bp == NULL) {
+            brelse(hbp);
+            return -1;
+        }
+        o = dxroom(bp, need);
+        if (o >= 0)
+            goto found;
+        nlbn = ((struct dxleaf *)bp->b_addr)->dl_next;
+        if (nlbn == 0)
+            break;
+        brelse(bp);
+        lbn = nlbn;
+    }
+
+    /* Every block of the leaf is full: find the buckets it serves */
+    lo = hi = b;
+    while (lo > 0 && hp->dh_bucket[lo - 1] == hp->dh_bucket[b])
+        lo--;
+    while (hi < hp->dh_nbucket - 1 && hp->dh_bucket[hi + 1] == hp->dh_bucket[b])
+        hi++;
+
+    nlbn = dirsize(dp) >> BSHIFT;
+    nbp = dxgrow(dp, nlbn);
+    if (nbp == NULL) {
+        brelse(bp);
+        brelse(hbp);
+        return -1;
+    }
+
+    if (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        dxsplit(bp, nbp, hp->dh_nbucket, mid);
+        for (i = mid; i <= hi; i++)
+            hp->dh_bucket[i] = nlbn;
+        dxwrite(nbp);
+        dxwrite(bp);
+        dxwrite(hbp);
+
+        /* The split stands on its own; the next one goes in a new transaction */
+        if (jfind(dp->i_dev)) {
+            iupdat(dp, time);
+            jrestart(dp->i_dev);
+        }
+        goto again;
+    }
+
+    ((struct dxleaf *)bp->b_addr)->dl_next = nlbn;
+    dxwrite(bp);
+    bp = nbp;
+    o = sizeof(struct dxleaf);
+
+found:
+    brelse(hbp);
+    dxput(bp, o, ip->i_number, dxtype(ip), u.u_dbuf, u.u_namlen);
+    dxwrite(bp);
+    dp->i_flag |= IUPD;
+    dp->i_mtime = time[1];
+    dp->i_ctime = time[1];
+    return 0;
+}
+
+/*
+ * dxremove - Remove the entry at u.u_offset from a hashed directory
+ *
+ * u.u_offset is as left by dxlookup.
+ */
+void dxremove(struct inode *dp) {
+    struct buf *bp;
+    struct ldirect *ep;
+    int off, o, prev;
+
+    off = u.u_offset[1] & BMASK;
+    bp = dxread(dp, u.u_offset[1] >> BSHIFT);
+    if (bp == NULL)
+        return;
+
+    prev = -1;
+    for (o = sizeof(struct dxleaf); o < off; o += ep->d_reclen) {
+        ep = (struct ldirect *)(bp->b_addr + o);
+        if (ep->d_reclen < LDIRHDR)
+            break;
+        prev = o;
+    }
+    if (o != off) {
+        brelse(bp);
+        u.u_error = EIO;
+        return;
+    }
+
+    ep = (struct ldirect *)(bp->b_addr + off);
+    if (prev < 0)
+        ep->d_ino = 0;
+    else
+        ((struct ldirect *)(bp->b_addr + prev))->d_reclen += ep->d_reclen;
+    dxwrite(bp);
+    dp->i_flag |= IUPD;
+    dp->i_mtime = time[1];
+    dp->i_ctime = time[1];
+}
+
+/*
+ * dxinit - Lay out an empty hashed directory holding "." and ".."
+ */
+int dxinit(struct inode *dp, ino_t parent) {
+    struct buf *hbp, *bp;
+    struct dxhead *hp;
+    int i;
+
+    hbp = dxgrow(dp, 0);
+    if (hbp == NULL)
+        return -1;
+    bp = dxgrow(dp, 1);
+    if (bp == NULL) {
+        brelse(hbp);
+        return -1;
+    }
+
+    clrbuf(hbp);
+    hp = (struct dxhead *)hbp->b_addr;
+    hp->dh_magic = DXMAGIC;
+    hp->dh_nbucket = DXNBUCKET;
+    for (i = 0; i < DXNBUCKET; i++)
+        hp->dh_bucket[i] = 1;
+
+    dxput(bp, sizeof(struct dxleaf), dp->i_number, DT_DIR, ".", 1);
+    dxput(bp, dxroom(bp, LDIRSIZ(2)), parent, DT_DIR, "..", 2);
+
+    dxwrite(bp);
+    dxwrite(hbp);
+    return 0;
+}
+
+/*
+ * dirprefetch - Start reading the i-list blocks of the inodes
+ * named in a directory block, so a listing that looks at each
+ * one finds them in core
+ *
+ * At most NIPREF reads are started for each block.
+ */
+#define NIPREF      4
+
+void dirprefetch(struct inode *dp, struct buf *bp, int lbn, int dx) {
+    struct ldirect *ep;
+    struct direct *vp;
+    int o, n;
+
+    n = 0;
+    if (dx) {
+        if (lbn == 0)
+            return;
+        for (o = sizeof(struct dxleaf); o + LDIRHDR <= BSIZE; o += ep->d_reclen) {
+            ep = (struct ldirect *)(bp->b_addr + o);
+            if (ep->d_reclen < LDIRHDR)
+                return;
+            if (ep->d_ino && iprefetch(dp->i_dev, ep->d_ino) && ++n >= NIPREF)
+                return;
+        }
+    } else {
+        for (vp = (struct direct *)bp->b_addr;
+             vp < (struct direct *)(bp->b_addr + BSIZE); vp++) {
+            if (vp->d_ino && iprefetch(dp->i_dev, vp->d_ino) && ++n >= NIPREF)
+                return;
+        }
+    }
+}
+
+/*
+ * dirread - Return the next live entry of a directory
+ *
+ * *offp is the byte offset to resume from (0 to start) and
+ * is advanced past the entry.  The name is copied to name,
+ * which must hold MAXNAMLEN+1 bytes, and the DT_* type to
+ * *typep unless it is NULL; a V6 entry's type comes from its
+ * inode (see dirprefetch).  Returns the name length, 0 at
+ * the end of the directory or -1 on error.
+ */
+int dirread(struct inode *dp, off_t *offp, ino_t *inop, char *name, int *typep) {
+    struct inode ic;
+    struct buf *bp;
+    struct ldirect *ep;
+    struct direct *vp;
+    uint32_t size;
+    int dx, lbn, n;
+
+    dx = dxisdir(dp);
+    size = dirsize(dp);
+    bp = NULL;
+    lbn = -1;
+
+    for (;;) {
+        if (dx) {
+            if (*offp < BSIZE)
+                *offp = BSIZE;
+            if ((*offp & BMASK) == 0)
+                *offp += sizeof(struct dxleaf);
+        }
+        if ((uint32_t)*offp >= size)
+            break;
+        if ((*offp >> BSHIFT) != lbn) {
+            if (bp)
+                brelse(bp);
+            lbn = *offp >> BSHIFT;
+            bp = dxread(dp, lbn);
+            if (bp == NULL)
+                return -1;
+            if (dp->i_lastr + 1 == lbn)
+                dirprefetch(dp, bp, lbn, dx);
+            dp->i_lastr = lbn;
+        }
+
+        if (dx) {
+            ep = (struct ldirect *)(bp->b_addr + (*offp & BMASK));
+            if (ep->d_reclen < LDIRHDR ||
+                (*offp & BMASK) + ep->d_reclen > BSIZE) {
+                brelse(bp);
+                u.u_error = EIO;
+                return -1;
+            }
+            *offp += ep->d_reclen;
+            if (ep->d_ino == 0)
+                continue;
+            *inop = ep->d_ino;
+            n = ep->d_namlen;
+            bcopy(ep->d_name, name, n);
+            if (typep)
+                *typep = ep->d_type;
+        } else {
+            vp = (struct direct *)(bp->b_addr + (*offp & BMASK));
+            *offp += sizeof(struct direct);
+            if (vp->d_ino == 0)
+                continue;
+            *inop = vp->d_ino;
+            for (n = 0; n < DIRSIZ && vp->d_name[n]; n++)
+                name[n] = vp->d_name[n];
+            if (typep) {
+                /* V6 entries carry no type: look at the inode */
+                if (n > 0 && ipeek(dp->i_dev, vp->d_ino, &ic) == 0 && ic.i_mode != 0)
+                    *typep = dxtype(&ic);
+                else
+                    *typep = DT_UNKNOWN;
+            }
+        }
+        if (n == 0)
+            continue;
+        name[n] = '\0';
+        brelse(bp);
+        return n;
+    }
+
+    if (bp)
+        brelse(bp);
+    return 0;
+}
+
+/*
+ * v6match - Compare a V6 entry name with a kernel string
+ *
+ * Names longer than DIRSIZ match on their first DIRSIZ bytes.
+ */
+static int v6match(const char *ent, const char *name) {
+    int i;
+
+    for (i = 0; i < DIRSIZ && ent[i] == name[i]; i++) {
+        if (name[i] == '\0')
+            return 1;
+    }
+    return i == DIRSIZ;
+}
+
+/*
+ * dirfind - Look up a kernel string name in a directory
+ *
+ * Returns the inode number, or 0 if not found.
+ * Unlike namei, u.u_dbuf and u.u_offset are left alone.
+ */
+ino_t dirfind(struct inode *dp, const char *name) {
+    char nbuf[DIRSIZ + 1];
+    off_t off;
+    ino_t ino;
+    int n;
+
+    for (n = 0; name[n] && n < MAXNAMLEN; n++)
+        ;
+    if (dxisdir(dp))
+        return dxfind(dp, name, n, &off);
+
+    off = 0;
+    while (dirread(dp, &off, &ino, nbuf, NULL) > 0) {
+        if (v6match(nbuf, name))
+            return ino;
+    }
+    return 0;
+}
+
+/*
+ * dirrepoint - Change the inode number of an existing entry
+ *
+ * Used to aim ".." at a directory's new parent.
+ */
+int dirrepoint(struct inode *dp, const char *name, ino_t ino) {
+    struct buf *bp;
+    char nbuf[DIRSIZ + 1];
+    off_t off, next;
+    ino_t old;
+    int n;
+
+    for (n = 0; name[n] && n < MAXNAMLEN; n++)
+        ;
+    if (dxisdir(dp)) {
+        if (dxfind(dp, name, n, &off) == 0)
+            goto bad;
+    } else {
+        next = 0;
+        for (;;) {
+            if (dirread(dp, &next, &old, nbuf, NULL) <= 0)
+                goto bad;
+            if (v6match(nbuf, name))
+                break;
+        }
+        off = next - sizeof(struct direct);
+    }
+
+    bp = dxread(dp, off >> BSHIFT);
+    if (bp == NULL)
+        return -1;
+    *(ino_t *)(bp->b_addr + (off & BMASK)) = ino;
+    dxwrite(bp);
+    dp->i_flag |= IUPD;
+    return 0;
+
+bad:
+    if (u.u_error == 0)
+        u.u_error = ENOENT;
+    return -1;
+}
+
+/*
+ * dirremove - Remove the entry found by namei(.., 2) from u.u_pdir
+ */
+void dirremove(void) {
+    jbegin(u.u_pdir->i_dev);
+    if (dxisdir(u.u_pdir)) {
+        dxremove(u.u_pdir);
+    } else {
+        u.u_offset[1] -= DIRSIZ + 2;
+        u.u_base = (caddr_t)&u.u_dent;
+        u.u_count = DIRSIZ + 2;
+        u.u_dent.u_ino = 0;
+        u.u_segflg = 1;
+        writei(u.u_pdir);
+    }
+    jend(u.u_pdir->i_dev);
+}
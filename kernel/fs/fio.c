@@ -12,6 +12,8 @@
 #include "include/file.h"
 #include "include/filsys.h"
 #include "include/inode.h"
+#include "include/proc.h"
+#include "include/text.h"
 #include "include/conf.h"
 #include "include/reg.h"
 
@@ -199,6 +201,9 @@ int access(struct inode *ip, int mode) {
             u.u_error = EROFS;
             return 1;
         }
+        if (ip->i_flag & ITEXT) {
+            xrele(ip);
+        }
         if (ip->i_flag & ITEXT) {
             u.u_error = ETXTBSY;
             return 1;
@@ -14,6 +14,7 @@
 #include "include/filsys.h"
 #include "include/buf.h"
 #include "include/conf.h"
+#include "include/journal.h"
 
 /* External declarations */
 extern struct inode inode[];
@@ -29,9 +30,81 @@ extern void brelse(struct buf *bp);
 extern void bwrite(struct buf *bp);
 extern struct filsys *getfs(dev_t dev);
 extern void bfree(dev_t dev, daddr_t bno);
+extern void allocrun(dev_t dev, int n);
 extern void ifree(dev_t dev, ino_t ino);
 extern void wdir(struct inode *ip);
 
+static void iwrite(struct inode *p, int sync);
+
+/*
+ * iload - Fill an in-core inode from its disk copy
+ */
+static void iload(struct inode *p, struct dinode *dp) {
+    int i;
+    
+    p->i_mode = dp->di_mode;
+    p->i_nlink = dp->di_nlink;
+    p->i_uid = dp->di_uid;
+    p->i_gid = dp->di_gid;
+    p->i_size0 = dp->di_size0;
+    p->i_size1 = dp->di_size1;
+    
+    for (i = 0; i < 8; i++) {
+        p->i_addr[i] = dp->di_addr[i];
+    }
+    
+    p->i_atime = ((time_t)dp->di_atime[0] << 16) | dp->di_atime[1];
+    p->i_mtime = ((time_t)dp->di_mtime[0] << 16) | dp->di_mtime[1];
+    p->i_ctime = p->i_mtime;
+    p->i_lastr = -1;
+    p->i_advice = FADV_NORMAL;
+    p->i_error = 0;
+}
+
+/*
+ * icache - Keep the other allocated inodes of a freshly read
+ * i-list block in unused slots of the inode table
+ *
+ * They are left with no references, so iget finds them and
+ * any other lookup can take the slot back.  Only free slots
+ * are used, never another cached inode's.
+ */
+static void icache(dev_t dev, struct buf *bp) {
+    struct inode *p, *q;
+    struct dinode *dp;
+    ino_t ino;
+    int k;
+    
+    p = &inode[0];
+    for (k = 0; k < 16; k++) {
+        ino = bp->b_blkno * 16 + k - 31;
+        dp = (struct dinode *)(bp->b_addr + 32 * k);
+        if (ino < 1 || (dp->di_mode & IALLOC) == 0) {
+            continue;
+        }
+        for (q = &inode[0]; q < &inode[NINODE]; q++) {
+            if (q->i_dev == dev && q->i_number == ino) {
+                break;
+            }
+        }
+        if (q < &inode[NINODE]) {
+            continue;
+        }
+        for (; p < &inode[NINODE]; p++) {
+            if (p->i_count == 0 && p->i_number == 0) {
+                break;
+            }
+        }
+        if (p == &inode[NINODE]) {
+            return;
+        }
+        p->i_dev = dev;
+        p->i_number = ino;
+        p->i_flag = 0;
+        iload(p, dp);
+    }
+}
+
 /*
  * iget - Look up an inode by device and inode number
  *
@@ -44,8 +117,6 @@ struct inode *iget(dev_t dev, ino_t ino) {
     struct inode *p, *empty;
     struct mount *mp;
     struct buf *bp;
-    struct dinode *dp;
-    int i;
 
 loop:
     empty = NULL;
@@ -77,8 +148,9 @@ loop:
             return p;
         }
         
-        /* Remember first empty slot */
-        if (empty == NULL && p->i_count == 0) {
+        /* Remember an empty slot, sparing cached inodes if possible */
+        if (p->i_count == 0 && (empty == NULL ||
+            (empty->i_number != 0 && p->i_number == 0))) {
             empty = p;
         }
     }
@@ -95,7 +167,6 @@ loop:
     p->i_number = ino;
     p->i_flag = ILOCK;
     p->i_count = 1;
-    p->i_lastr = -1;
     
     /* Read inode from disk
      * Inode number to block: (ino + 31) / 16
@@ -112,25 +183,75 @@ loop:
     /* Copy disk inode to in-core inode
      * Offset within block: 32 * ((ino + 31) % 16)
      */
-    dp = (struct dinode *)(bp->b_addr + 32 * ((ino + 31) % 16));
-    
-    p->i_mode = dp->di_mode;
-    p->i_nlink = dp->di_nlink;
-    p->i_uid = dp->di_uid;
-    p->i_gid = dp->di_gid;
-    p->i_size0 = dp->di_size0;
-    p->i_size1 = dp->di_size1;
+    iload(p, (struct dinode *)(bp->b_addr + 32 * ((ino + 31) % 16)));
+    icache(dev, bp);
     
-    for (i = 0; i < 8; i++) {
-        p->i_addr[i] = dp->di_addr[i];
+    brelse(bp);
+    return p;
+}
+
+/*
+ * ipeek - Copy an inode's attributes without locking it
+ *
+ * The in-core inode is used if there is one, following
+ * mounts as iget does; otherwise the disk copy is read and
+ * its block's inodes are cached.  Only the attributes in
+ * *cp are meaningful.  Returns 0, or -1 on an I/O error.
+ */
+int ipeek(dev_t dev, ino_t ino, struct inode *cp) {
+    struct inode *p;
+    struct mount *mp;
+    struct buf *bp;
+
+loop:
+    for (p = &inode[0]; p < &inode[NINODE]; p++) {
+        if (p->i_dev != dev || p->i_number != ino) {
+            continue;
+        }
+        if (p->i_flag & IMOUNT) {
+            for (mp = &mount[0]; mp < &mount[NMOUNT]; mp++) {
+                if (mp->m_inodp == p) {
+                    dev = mp->m_dev;
+                    ino = ROOTINO;
+                    goto loop;
+                }
+            }
+        }
+        *cp = *p;
+        return 0;
     }
     
-    p->i_atime = ((time_t)dp->di_atime[0] << 16) | dp->di_atime[1];
-    p->i_mtime = ((time_t)dp->di_mtime[0] << 16) | dp->di_mtime[1];
-    p->i_ctime = p->i_mtime;
-    
+    bp = bread(dev, (ino + 31) / 16);
+    if (bp->b_flags & B_ERROR) {
+        brelse(bp);
+        return -1;
+    }
+    cp->i_dev = dev;
+    cp->i_number = ino;
+    iload(cp, (struct dinode *)(bp->b_addr + 32 * ((ino + 31) % 16)));
+    icache(dev, bp);
     brelse(bp);
-    return p;
+    return 0;
+}
+
+/*
+ * iprefetch - Start reading the i-list block of an inode
+ * that is not in core.  Returns 1 if a read was started.
+ */
+int iprefetch(dev_t dev, ino_t ino) {
+    struct inode *p;
+    struct filsys *fp;
+    
+    fp = getfs(dev);
+    if (fp == NULL || ino < 1 || (ino + 31) / 16 >= fp->s_isize + 2) {
+        return 0;
+    }
+    for (p = &inode[0]; p < &inode[NINODE]; p++) {
+        if (p->i_dev == dev && p->i_number == ino) {
+            return 0;
+        }
+    }
+    return bprefetch(dev, (ino + 31) / 16);
 }
 
 /*
@@ -148,13 +269,19 @@ void iput(struct inode *p) {
     
     if (p->i_count == 1) {
         /* Last reference - handle cleanup */
+        jbegin(p->i_dev);
         if (p->i_nlink <= 0) {
             itrunc(p);
             p->i_mode = 0;
             ifree(p->i_dev, p->i_number);
+        } else {
+            /* Delayed-allocation data must get its blocks while the inode is in core */
+            dalloc(p);
         }
         
-        iupdat(p, time);
+        iwrite(p, 0);
+        jend(p->i_dev);
+        bdetach(p);
         p->i_flag = 0;
         p->i_count = 0;
         p->i_number = 0;  /* Mark slot as free AFTER count is 0 */
@@ -167,35 +294,16 @@ void iput(struct inode *p) {
 }
 
 /*
- * iupdat - Update an inode on disk
+ * icopy - Copy an in-core inode into its i-list block
  *
- * Check accessed and update flags on an inode structure.
- * If either is on, update the inode with the corresponding dates.
+ * The buffer must hold the block containing the inode.
+ * The inode is clean afterwards.
  */
-void iupdat(struct inode *p, time_t *tm) {
-    struct buf *bp;
+static void icopy(struct inode *p, struct buf *bp) {
     struct dinode *dp;
-    struct filsys *fp;
     int i;
-    daddr_t blkno;
-    int offset;
     
-    if ((p->i_flag & (IUPD | IACC)) == 0) {
-        return;
-    }
-    
-    fp = getfs(p->i_dev);
-    if (fp == NULL || fp->s_ronly) {
-        return;
-    }
-    
-    /* Calculate disk location */
-    i = p->i_number + 31;
-    blkno = i / 16;
-    offset = 32 * (i % 16);
-    
-    bp = bread(p->i_dev, blkno);
-    dp = (struct dinode *)(bp->b_addr + offset);
+    dp = (struct dinode *)(bp->b_addr + 32 * ((p->i_number + 31) % 16));
     
     /* Copy in-core inode to disk inode */
     dp->di_mode = p->i_mode;
@@ -210,7 +318,6 @@ void iupdat(struct inode *p, time_t *tm) {
     }
     
     /* Update times - di_atime and di_mtime are uint16_t[2] arrays */
-    (void)tm;
     if (p->i_flag & IACC) {
         dp->di_atime[0] = (uint16_t)(p->i_atime >> 16);
         dp->di_atime[1] = (uint16_t)(p->i_atime & 0xFFFF);
@@ -219,8 +326,103 @@ void iupdat(struct inode *p, time_t *tm) {
         dp->di_mtime[0] = (uint16_t)(p->i_mtime >> 16);
         dp->di_mtime[1] = (uint16_t)(p->i_mtime & 0xFFFF);
     }
+    p->i_flag &= ~(IUPD | IACC | ISIZE);
+}
+
+/*
+ * iwrite - Write an inode to its i-list block if it is dirty,
+ * waiting for the write if sync is set
+ */
+static void iwrite(struct inode *p, int sync) {
+    struct buf *bp;
+    struct filsys *fp;
+    
+    if ((p->i_flag & (IUPD | IACC)) == 0) {
+        return;
+    }
+    
+    fp = getfs(p->i_dev);
+    if (fp == NULL || fp->s_ronly) {
+        return;
+    }
+    
+    bp = bread(p->i_dev, (p->i_number + 31) / 16);
+    icopy(p, bp);
+    if (jlog(bp)) {
+        return;
+    }
+    if (sync) {
+        bwrite(bp);
+    } else {
+        bdwrite(bp);
+    }
+}
+
+/*
+ * iupdat - Update an inode on disk
+ *
+ * Check accessed and update flags on an inode structure.
+ * If either is on, update the inode with the corresponding dates.
+ */
+void iupdat(struct inode *p, time_t *tm) {
+    (void)tm;
+    iwrite(p, 1);
+}
+
+/*
+ * iflush - Write back all dirty inodes of a device (or of
+ * every device for NODEV)
+ *
+ * The inodes are gathered and sorted by i-list block, and
+ * each block is read once, has all of its dirty inodes
+ * copied in, and is written asynchronously.
+ */
+void iflush(dev_t dev) {
+    struct inode *list[NINODE];
+    struct inode *ip;
+    struct filsys *fp;
+    struct buf *bp;
+    daddr_t bn;
+    int i, j, n;
+    
+    /* Lock them in i-list order */
+    n = 0;
+    for (ip = &inode[0]; ip < &inode[NINODE]; ip++) {
+        if (ip->i_count == 0 || (ip->i_flag & ILOCK) ||
+            (ip->i_flag & (IUPD | IACC)) == 0 ||
+            (dev != NODEV && ip->i_dev != dev)) {
+            continue;
+        }
+        fp = getfs(ip->i_dev);
+        if (fp == NULL || fp->s_ronly) {
+            continue;
+        }
+        ip->i_flag |= ILOCK;
+        for (i = n++; i > 0 && (list[i - 1]->i_dev > ip->i_dev ||
+             (list[i - 1]->i_dev == ip->i_dev &&
+              list[i - 1]->i_number > ip->i_number)); i--) {
+            list[i] = list[i - 1];
+        }
+        list[i] = ip;
+    }
     
-    bwrite(bp);
+    /* One write for each block */
+    for (i = 0; i < n; i = j) {
+        ip = list[i];
+        bn = (ip->i_number + 31) / 16;
+        bp = bread(ip->i_dev, bn);
+        for (j = i; j < n && list[j]->i_dev == ip->i_dev &&
+             (list[j]->i_number + 31) / 16 == bn; j++) {
+            icopy(list[j], bp);
+        }
+        if (!jlog(bp)) {
+            bawrite(bp);
+        }
+    }
+    
+    for (i = 0; i < n; i++) {
+        prele(list[i]);
+    }
 }
 
 /*
@@ -233,14 +435,18 @@ void itrunc(struct inode *ip) {
     struct buf *bp, *ibp;
     daddr_t *dp, *ep;
     daddr_t bn;
-    int i;
+    int i, n;
     
     /* Don't truncate devices */
     if ((ip->i_mode & IFMT) == IFCHR || (ip->i_mode & IFMT) == IFBLK) {
         return;
     }
     
+    /* Data not yet on disk is simply dropped */
+    dinval(ip);
+    
     /* Free blocks in reverse order */
+    jbegin(ip->i_dev);
     for (i = 7; i >= 0; i--) {
         bn = ip->i_addr[i];
         if (bn == 0) {
@@ -273,18 +479,41 @@ void itrunc(struct inode *ip) {
                     brelse(ibp);
                 }
                 bfree(ip->i_dev, *ep);
+
+                /*
+                 * With a journal, the freed entry is cleared so a
+                 * transaction may end here: what is still listed
+                 * is still allocated.
+                 */
+                if (jfind(ip->i_dev)) {
+                    *ep = 0;
+                    n = ep - dp;
+                    jlog(bp);
+                    jrestart(ip->i_dev);
+                    bp = bread(ip->i_dev, bn);
+                    dp = (daddr_t *)bp->b_addr;
+                    ep = dp + n;
+                }
             }
             brelse(bp);
         }
         
         bfree(ip->i_dev, bn);
         ip->i_addr[i] = 0;
+        
+        /* One transaction per slot keeps a large file within the log */
+        if (jfind(ip->i_dev)) {
+            ip->i_flag |= IUPD;
+            iupdat(ip, time);
+            jrestart(ip->i_dev);
+        }
     }
+    jend(ip->i_dev);
     
     ip->i_mode &= ~ILARG;
     ip->i_size0 = 0;
     ip->i_size1 = 0;
-    ip->i_flag |= IUPD;
+    ip->i_flag |= IUPD | ISIZE;
 }
 
 /*
@@ -360,10 +589,23 @@ struct inode *maknode(mode_t mode) {
  * wdir - Write a directory entry
  *
  * Parameters left as side effects to a call to namei.
+ * Hashed directories place the entry through their index.
+ * The inode goes in the same transaction as its entry.
  */
 void wdir(struct inode *ip) {
+    dev_t dev;
     int i;
     
+    dev = u.u_pdir->i_dev;
+    jbegin(dev);
+    iupdat(ip, time);
+    if (dxisdir(u.u_pdir)) {
+        dxenter(u.u_pdir, ip);
+        iput(u.u_pdir);
+        jend(dev);
+        return;
+    }
+    
     u.u_dent.u_ino = ip->i_number;
     for (i = 0; i < DIRSIZ; i++) {
         u.u_dent.u_name[i] = u.u_dbuf[i];
@@ -376,6 +618,20 @@ void wdir(struct inode *ip) {
     extern void writei(struct inode *ip);
     writei(u.u_pdir);
     iput(u.u_pdir);
+    jend(dev);
+}
+
+/*
+ * bmrelse - Release an indirect block bmap has changed
+ *
+ * It goes to the journal, or else becomes a delayed write
+ * on the file's dirty list so fsync will find it.
+ */
+static void bmrelse(struct inode *ip, struct buf *bp) {
+    if (!jlog(bp)) {
+        bown(bp, ip);
+        bdwrite(bp);
+    }
 }
 
 /*
@@ -406,8 +662,9 @@ daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg) {
                     ip->i_addr[i] = 0;
                 }
                 ip->i_addr[0] = bp->b_blkno;
-                bdwrite(bp);
+                bmrelse(ip, bp);
                 ip->i_mode |= ILARG;
+                ip->i_flag |= ISIZE;
             } else {
                 return (daddr_t)-1;
             }
@@ -422,6 +679,7 @@ daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg) {
                 nb = bp->b_blkno;
                 bdwrite(bp);
                 ip->i_addr[bn] = nb;
+                ip->i_flag |= ISIZE;
             }
             return nb;
         }
@@ -456,7 +714,8 @@ daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg) {
         }
         nb = bp->b_blkno;
         ip->i_addr[j] = nb;
-        bdwrite(bp);
+        ip->i_flag |= ISIZE;
+        bmrelse(ip, bp);
     }
     
     /* Handle double indirect */
@@ -473,8 +732,9 @@ daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg) {
             }
             nb = nbp->b_blkno;
             bap[j] = nb;
-            bdwrite(nbp);
-            bdwrite(bp);
+            ip->i_flag |= ISIZE;
+            bmrelse(ip, nbp);
+            bmrelse(ip, bp);
         } else {
             brelse(bp);
         }
@@ -499,8 +759,9 @@ daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg) {
         }
         nb = nbp->b_blkno;
         bap[i] = nb;
+        ip->i_flag |= ISIZE;
         bdwrite(nbp);
-        bdwrite(bp);
+        bmrelse(ip, bp);
     } else {
         brelse(bp);
     }
@@ -508,6 +769,66 @@ daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg) {
     return nb;
 }
 
+/*
+ * iprealloc - Give blocks to the holes among n blocks of a
+ * file from lbn on
+ *
+ * Each stretch of holes is handed a run of consecutive free
+ * blocks by allocrun, so a file allocated ahead of its writes
+ * is contiguous on disk.  New blocks are zeroed, as alloc
+ * leaves them.  The caller holds the inode locked.  Returns
+ * -1 with u_error set if space runs out.
+ */
+int iprealloc(struct inode *ip, daddr_t lbn, int n) {
+    daddr_t bn, end;
+    int holes, len;
+    
+    /* Data already waiting for blocks gets them first */
+    dalloc(ip);
+    
+    while (n > 0) {
+        len = n < NICFREE - 1 ? n : NICFREE - 1;
+        end = lbn + len;
+        holes = 0;
+        for (bn = lbn; bn < end; bn++) {
+            if (bmap(ip, bn, 0) <= 0) {
+                holes++;
+            }
+        }
+        if (holes == 0) {
+            lbn = end;
+            n -= len;
+            continue;
+        }
+        
+        jbegin(ip->i_dev);
+        allocrun(ip->i_dev, holes);
+        for (; lbn < end; lbn++, n--) {
+            if (bmap(ip, lbn, 0) > 0) {
+                continue;
+            }
+            if (!jroom(ip->i_dev, 3)) {
+                ip->i_flag |= IUPD;
+                iupdat(ip, time);
+                jrestart(ip->i_dev);
+            }
+            bn = bmap(ip, lbn, 1);
+            if (bn == 0 || bn == (daddr_t)-1) {
+                jend(ip->i_dev);
+                return -1;
+            }
+        }
+        
+        /* One transaction per stretch keeps a large file within the log */
+        if (jfind(ip->i_dev)) {
+            ip->i_flag |= IUPD;
+            iupdat(ip, time);
+        }
+        jend(ip->i_dev);
+    }
+    return 0;
+}
+
 /* External declaration for alloc */
 extern struct buf *alloc(dev_t dev);
 extern void bdwrite(struct buf *bp);
@@ -0,0 +1,714 @@
+/* journal.c - Unix V6 x86 Port Metadata Journal
+ *
+ * Metadata blocks (inode blocks, directory blocks, indirect
+ * blocks, free list chain blocks and the superblock) reach
+ * their home only after a copy of them has reached the log.
+ * A buffer holding a logged block is marked B_JLOG, which
+ * keeps getblk and bflush from writing it early; when its
+ * transaction commits the flag is dropped and the buffer
+ * goes home as an ordinary delayed write.
+ *
+ * Operations bracket their updates with jbegin/jend.  A
+ * commit waits for the operations in the running transaction
+ * to finish, so the changes made by every process since the
+ * last commit go to the log together in one sequential write,
+ * and no operation is ever half on the log.  Each operation
+ * reserves room in the transaction when it begins; one that
+ * does not fit waits for the transaction to commit.  The
+ * journal keeps track of which process has an operation open
+ * on it, so one process may work on several file systems.
+ *
+ * When the log fills, the committed transactions on it are
+ * replayed to their homes and it starts over.  A block freed
+ * and reallocated while the log holds a copy of it would be
+ * overwritten by that replay, so such a block is revoked: the
+ * log is started over before it is handed out again.
+ */
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/user.h"
+#include "include/proc.h"
+#include "include/systm.h"
+#include "include/buf.h"
+#include "include/conf.h"
+#include "include/filsys.h"
+#include "include/journal.h"
+
+/* External declarations */
+extern struct user u;
+extern struct bdevsw bdevsw[];
+extern time_t time[];
+extern void kprintf(const char *fmt, ...);
+extern void prdev(const char *msg, dev_t dev);
+extern void sleep(void *chan, int pri);
+extern void wakeup(void *chan);
+extern struct buf *bread(dev_t dev, daddr_t blkno);
+extern void brelse(struct buf *bp);
+extern void bdwrite(struct buf *bp);
+extern struct buf *incore(dev_t dev, blkno_t blkno);
+extern void bcopy(const void *src, void *dst, int count);
+extern int spl6(void);
+extern int spl0(void);
+extern struct buf bfreelist;
+
+struct journal journal[NMOUNT];
+
+/*
+ * Log I/O goes through a private buffer, as swapping does
+ * through swbuf, so a commit never needs the buffer cache.
+ * jcopy holds the transaction being written, the superblock
+ * first; jlock serializes commits, which share both.
+ */
+static struct buf jbuf;
+static char jhbuf[BSIZE];
+static char jcopy[JMAXBLK + 1][BSIZE];
+static int jlock;
+
+/*
+ * jio - Transfer blocks between core and the disk
+ * Returns -1 on an I/O error.
+ */
+static int jio(dev_t dev, daddr_t blkno, caddr_t addr, int count, int rdflg) {
+    struct buf *bp;
+    int err;
+
+    bp = &jbuf;
+    spl6();
+    while (bp->b_flags & B_BUSY) {
+        bp->b_flags |= B_WANTED;
+        sleep(bp, PRIBIO);
+    }
+    bp->b_flags = B_BUSY | B_PHYS;
+    spl0();
+
+    bp->b_dev = dev;
+    bp->b_blkno = blkno;
+    bp->b_addr = addr;
+    bp->b_wcount = -(count * (BSIZE / 2));
+    bp->b_error = 0;
+    if (rdflg) {
+        bp->b_flags |= B_READ;
+    }
+
+    (*bdevsw[major(dev)].d_strategy)(bp);
+
+    spl6();
+    while ((bp->b_flags & B_DONE) == 0) {
+        sleep(bp, PRIBIO);
+    }
+    spl0();
+
+    err = bp->b_flags & B_ERROR;
+    if (bp->b_flags & B_WANTED) {
+        wakeup(bp);
+    }
+    bp->b_flags &= ~(B_BUSY | B_WANTED);
+    return err ? -1 : 0;
+}
+
+/*
+ * jsum - Fold a block into a transaction checksum
+ */
+static uint32_t jsum(uint32_t sum, caddr_t addr) {
+    uint32_t *p;
+    int i;
+
+    p = (uint32_t *)addr;
+    for (i = 0; i < (int)(BSIZE / sizeof(uint32_t)); i++) {
+        sum = ((sum << 1) | (sum >> 31)) + *p++;
+    }
+    return sum;
+}
+
+/*
+ * jlockup - Take the commit lock
+ */
+static void jlockup(void) {
+    while (jlock) {
+        sleep(&jlock, PRIBIO);
+    }
+    jlock++;
+}
+
+/*
+ * junlock - Release the commit lock
+ */
+static void junlock(void) {
+    jlock = 0;
+    wakeup(&jlock);
+}
+
+/*
+ * jreset - Start the log over
+ * The header names the running transaction as the
+ * first one to look for.
+ */
+static void jreset(struct journal *jp) {
+    struct jhead *hp;
+    int i;
+
+    for (i = 0; i < BSIZE; i++) {
+        jhbuf[i] = 0;
+    }
+    hp = (struct jhead *)jhbuf;
+    hp->jh_magic = JMAGIC;
+    hp->jh_seq = jp->j_seq;
+    if (jio(jp->j_dev, jp->j_start, jhbuf, 1, 0) < 0) {
+        prdev("journal header", jp->j_dev);
+    }
+    jp->j_pos = jp->j_start + 1;
+    jp->j_npass = 0;
+}
+
+/*
+ * jreplay - Write every committed block on the log home
+ *
+ * Transactions are read in order starting from the one
+ * named by seq, and the scan stops at the first that is
+ * incomplete.  Later copies of a block overwrite earlier
+ * ones, so each block ends with its last committed value.
+ * Clean cached copies are dropped so that they are read
+ * again.  Returns the number of transactions replayed.
+ */
+static int jreplay(struct journal *jp, uint32_t seq, daddr_t limit) {
+    struct jhead *hp;
+    struct jhead d;
+    struct buf *bp;
+    daddr_t pos;
+    uint32_t sum;
+    int i, n;
+
+    hp = (struct jhead *)jhbuf;
+    n = 0;
+    pos = jp->j_start + 1;
+    while (pos < limit) {
+        if (jio(jp->j_dev, pos, jhbuf, 1, 1) < 0) {
+            break;
+        }
+        if (hp->jh_magic != JDESC || hp->jh_seq != seq ||
+            hp->jh_count == 0 || hp->jh_count > JMAXBLK + 1 ||
+            pos + (daddr_t)hp->jh_count + 2 > jp->j_end) {
+            break;
+        }
+        bcopy(hp, &d, sizeof(d));
+
+        /* The blocks are contiguous on the log */
+        if (jio(jp->j_dev, pos + 1, jcopy[0], d.jh_count, 1) < 0) {
+            break;
+        }
+        sum = 0;
+        for (i = 0; i < (int)d.jh_count; i++) {
+            sum = jsum(sum, jcopy[i]);
+        }
+
+        /* Without a matching commit record the transaction never happened */
+        if (jio(jp->j_dev, pos + d.jh_count + 1, jhbuf, 1, 1) < 0) {
+            break;
+        }
+        if (hp->jh_magic != JCOMMIT || hp->jh_seq != seq || hp->jh_sum != sum) {
+            break;
+        }
+
+        for (i = 0; i < (int)d.jh_count; i++) {
+            jio(jp->j_dev, d.jh_blkno[i], jcopy[i], 1, 0);
+            bp = incore(jp->j_dev, d.jh_blkno[i]);
+            if (bp && (bp->b_flags & (B_BUSY | B_DELWRI)) == 0) {
+                bp->b_flags &= ~B_DONE;
+            }
+        }
+        pos += d.jh_count + 2;
+        seq++;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * jcheckpoint - Make room on the log
+ * Called with jlock held.
+ */
+static void jcheckpoint(struct journal *jp) {
+    struct jhead *hp;
+
+    hp = (struct jhead *)jhbuf;
+    if (jio(jp->j_dev, jp->j_start, jhbuf, 1, 1) < 0 || hp->jh_magic != JMAGIC) {
+        prdev("journal header", jp->j_dev);
+    } else {
+        jreplay(jp, hp->jh_seq, jp->j_pos);
+    }
+    jreset(jp);
+}
+
+/*
+ * jintx - Is the block part of the running transaction?
+ */
+static int jintx(struct journal *jp, daddr_t blkno) {
+    int i;
+
+    for (i = 0; i < jp->j_nblk; i++) {
+        if (jp->j_blkno[i] == blkno) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * jwrite - Commit the running transaction
+ *
+ * The transaction is copied, and a new one started, before
+ * any I/O, so other processes may go on logging blocks while
+ * this one writes the descriptor, the blocks and the commit
+ * record.  Blocks are then released to go home, except those
+ * logged again in the meantime.
+ */
+static void jwrite(struct journal *jp) {
+    struct filsys *fp;
+    struct jhead *hp;
+    struct buf *bp;
+    daddr_t pos;
+    uint32_t seq, sum;
+    int i, n, err;
+
+    jlockup();
+    fp = getfs(jp->j_dev);
+    if (fp == NULL || (jp->j_nblk == 0 && fp->s_fmod == 0)) {
+        junlock();
+        return;
+    }
+
+    if (jp->j_pos + JMAXBLK + 3 > jp->j_end || jp->j_npass + JMAXBLK > JNPASS) {
+        jcheckpoint(jp);
+    }
+
+    /* Copy the transaction: the superblock, then the logged blocks */
+    hp = (struct jhead *)jhbuf;
+    for (i = 0; i < BSIZE; i++) {
+        jhbuf[i] = 0;
+    }
+    fp->s_fmod = 0;
+    fp->s_time[0] = time[0];
+    fp->s_time[1] = time[1];
+    bcopy(fp, jcopy[0], BSIZE);
+    hp->jh_blkno[0] = 1;
+    n = 1;
+    for (i = 0; i < jp->j_nblk; i++) {
+        bp = incore(jp->j_dev, jp->j_blkno[i]);
+        if (bp == NULL || (bp->b_flags & B_JLOG) == 0) {
+            continue;
+        }
+        bcopy(bp->b_addr, jcopy[n], BSIZE);
+        hp->jh_blkno[n++] = jp->j_blkno[i];
+        jp->j_pass[jp->j_npass++] = jp->j_blkno[i];
+    }
+    seq = jp->j_seq++;
+    jp->j_nblk = 0;
+    pos = jp->j_pos;
+    jp->j_pos += n + 2;
+
+    sum = 0;
+    for (i = 0; i < n; i++) {
+        sum = jsum(sum, jcopy[i]);
+    }
+    hp->jh_magic = JDESC;
+    hp->jh_seq = seq;
+    hp->jh_count = n;
+    err = jio(jp->j_dev, pos, jhbuf, 1, 0);
+    err |= jio(jp->j_dev, pos + 1, jcopy[0], n, 0);
+    hp->jh_magic = JCOMMIT;
+    hp->jh_sum = sum;
+    err |= jio(jp->j_dev, pos + n + 1, jhbuf, 1, 0);
+    if (err) {
+        prdev("journal write", jp->j_dev);
+    }
+
+    /* On the log: the blocks may go home */
+    for (i = 1; i < n; i++) {
+        if (jintx(jp, hp->jh_blkno[i])) {
+            continue;
+        }
+        bp = incore(jp->j_dev, hp->jh_blkno[i]);
+        if (bp) {
+            bp->b_flags &= ~B_JLOG;
+        }
+    }
+    jp->j_cseq = seq;
+    junlock();
+
+    /* getblk may be waiting for these buffers */
+    if (bfreelist.b_flags & B_WANTED) {
+        bfreelist.b_flags &= ~B_WANTED;
+        wakeup(&bfreelist);
+    }
+}
+
+/*
+ * jdrain - Commit the running transaction once the operations
+ * in it have finished.  New operations wait meanwhile, so the
+ * transaction holds only whole operations.
+ */
+static void jdrain(struct journal *jp) {
+    uint32_t seq;
+
+    seq = jp->j_seq;
+    jp->j_want++;
+    while (jp->j_nactive > 0) {
+        sleep(&jp->j_nactive, PRIBIO);
+    }
+    if (jp->j_cseq < seq) {
+        jwrite(jp);
+    }
+    jp->j_nres = 0;
+    if (--jp->j_want == 0) {
+        wakeup(&jp->j_nactive);
+    }
+}
+
+/*
+ * jfind - Map a device to its journal, NULL if it has none
+ */
+struct journal *jfind(dev_t dev) {
+    struct journal *jp;
+
+    for (jp = &journal[0]; jp < &journal[NMOUNT]; jp++) {
+        if (jp->j_end != 0 && jp->j_dev == dev) {
+            return jp;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * jinit - Attach the journal of a file system being mounted
+ *
+ * Called with the in-core superblock just read.  Any
+ * committed transactions left on the log are replayed and,
+ * if there were some, the superblock is read again.
+ */
+int jinit(dev_t dev, struct filsys *fp) {
+    struct journal *jp;
+    struct jhead *hp;
+    struct buf *bp;
+    int n;
+
+    if (fp->s_jsize == 0) {
+        return 0;
+    }
+    if (fp->s_jsize < JMINSIZE || fp->s_jstart < fp->s_fsize) {
+        prdev("bad journal", dev);
+        return 0;
+    }
+    for (jp = &journal[0]; jp < &journal[NMOUNT]; jp++) {
+        if (jp->j_end == 0) {
+            break;
+        }
+    }
+    if (jp == &journal[NMOUNT]) {
+        return 0;
+    }
+
+    jlockup();
+    jp->j_dev = dev;
+    jp->j_start = fp->s_jstart;
+    jp->j_end = fp->s_jstart + fp->s_jsize;
+    jp->j_nactive = 0;
+    jp->j_nres = 0;
+    jp->j_want = 0;
+    jp->j_nblk = 0;
+    for (n = 0; n < JNOP; n++) {
+        jp->j_op[n].jo_proc = NULL;
+    }
+
+    n = 0;
+    hp = (struct jhead *)jhbuf;
+    if (jio(dev, jp->j_start, jhbuf, 1, 1) == 0 && hp->jh_magic == JMAGIC) {
+        jp->j_seq = hp->jh_seq;
+        n = jreplay(jp, jp->j_seq, jp->j_end);
+        jp->j_seq += n;
+    } else {
+        jp->j_seq = 1;
+    }
+    jp->j_cseq = jp->j_seq - 1;
+    jreset(jp);
+    junlock();
+
+    if (n) {
+        kprintf("journal: replayed %d transactions on dev %d/%d\n",
+                n, major(dev), minor(dev));
+        bp = bread(dev, 1);
+        bcopy(bp->b_addr, fp, BSIZE);
+        brelse(bp);
+    }
+    return n;
+}
+
+/*
+ * jclose - Detach the journal of a file system being unmounted
+ * Everything is committed and written home, leaving the log empty.
+ */
+void jclose(dev_t dev) {
+    struct journal *jp;
+
+    jp = jfind(dev);
+    if (jp == NULL) {
+        return;
+    }
+    jcommit(dev);
+    jlockup();
+    jcheckpoint(jp);
+    jp->j_end = 0;
+    junlock();
+}
+
+/*
+ * jopfind - The operation the current process has open on
+ * journal jp, NULL if none
+ */
+static struct jop *jopfind(struct journal *jp) {
+    struct jop *op;
+
+    for (op = &jp->j_op[0]; op < &jp->j_op[JNOP]; op++) {
+        if (op->jo_proc == u.u_procp) {
+            return op;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * jbegin - Start an operation
+ * Operations nest; only the outermost one counts.  It
+ * reserves JRESV blocks of the running transaction, first
+ * committing the transaction if that has no room.
+ */
+void jbegin(dev_t dev) {
+    struct journal *jp;
+    struct jop *op;
+
+    jp = jfind(dev);
+    if (jp == NULL) {
+        return;
+    }
+    op = jopfind(jp);
+    if (op != NULL) {
+        op->jo_nest++;
+        return;
+    }
+    while (jp->j_want || jp->j_nres + JRESV > JMAXBLK) {
+        if (jp->j_want) {
+            sleep(&jp->j_nactive, PRIBIO);
+        } else {
+            jdrain(jp);
+        }
+    }
+
+    /* With room for JRESV more, a slot is free */
+    for (op = &jp->j_op[0]; op->jo_proc != NULL; op++)
+        ;
+    op->jo_proc = u.u_procp;
+    op->jo_nest = 1;
+    op->jo_nlog = 0;
+    jp->j_nactive++;
+    jp->j_nres += JRESV;
+}
+
+/*
+ * jend - Finish an operation, giving back the room it
+ * reserved but did not use
+ */
+void jend(dev_t dev) {
+    struct journal *jp;
+    struct jop *op;
+
+    jp = jfind(dev);
+    if (jp == NULL || (op = jopfind(jp)) == NULL) {
+        return;
+    }
+    if (--op->jo_nest > 0) {
+        return;
+    }
+    if (op->jo_nlog < JRESV) {
+        jp->j_nres -= JRESV - op->jo_nlog;
+    }
+    op->jo_proc = NULL;
+    if (--jp->j_nactive == 0) {
+        wakeup(&jp->j_nactive);
+    }
+}
+
+/*
+ * jrestart - Split a long operation at a point where the
+ * changes it has made so far stand on their own, so that it
+ * need not fit in one transaction (see itrunc).  This holds
+ * even when the operation is nested in another.
+ */
+void jrestart(dev_t dev) {
+    struct journal *jp;
+    struct jop *op;
+    int n;
+
+    jp = jfind(dev);
+    if (jp == NULL || (op = jopfind(jp)) == NULL) {
+        return;
+    }
+    n = op->jo_nest;
+    op->jo_nest = 1;
+    jend(dev);
+    jbegin(dev);
+    jopfind(jp)->jo_nest = n;
+}
+
+/*
+ * jroom - Has the caller's operation n blocks of its
+ * reservation left?  A long operation asks before each step
+ * and splits itself with jrestart when it has not.
+ */
+int jroom(dev_t dev, int n) {
+    struct journal *jp;
+    struct jop *op;
+
+    jp = jfind(dev);
+    if (jp == NULL || (op = jopfind(jp)) == NULL) {
+        return 1;
+    }
+    return op->jo_nlog + n <= JRESV;
+}
+
+/*
+ * jactive - Has the current process an operation open on
+ * any journal?
+ */
+int jactive(void) {
+    struct journal *jp;
+
+    for (jp = &journal[0]; jp < &journal[NMOUNT]; jp++) {
+        if (jp->j_end != 0 && jopfind(jp) != NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * jlog - Release a modified metadata buffer through the journal
+ *
+ * The buffer becomes a delayed write held until its
+ * transaction commits, counted against the caller's
+ * operation.  A block logged outside any operation stands
+ * alone: it takes a free block of the transaction, after
+ * committing it if it is full.  The running transaction is
+ * never committed under an open operation, so one that goes
+ * past the room left is a bug.  Returns 0, leaving the buffer
+ * to the caller, if the device has no journal.
+ */
+int jlog(struct buf *bp) {
+    struct journal *jp;
+    struct jop *op;
+
+    jp = jfind(bp->b_dev);
+    if (jp == NULL) {
+        return 0;
+    }
+    if (!jintx(jp, bp->b_blkno)) {
+        op = jopfind(jp);
+        if (op == NULL) {
+            while (jp->j_want || jp->j_nres >= JMAXBLK) {
+                if (jp->j_want) {
+                    sleep(&jp->j_nactive, PRIBIO);
+                } else {
+                    jdrain(jp);
+                }
+            }
+            jp->j_nres++;
+        } else if (++op->jo_nlog > JRESV) {
+            if (jp->j_nres >= JMAXBLK) {
+                panic("journal overflow");
+            }
+            jp->j_nres++;
+        }
+        jp->j_blkno[jp->j_nblk++] = bp->b_blkno;
+    }
+    bp->b_flags |= B_JLOG;
+    bdwrite(bp);
+    return 1;
+}
+
+/*
+ * jrevoke - Forget any logged copy of a block being reallocated
+ * Called by alloc, which may hand the block out as file data.
+ */
+void jrevoke(dev_t dev, daddr_t bno) {
+    struct journal *jp;
+    struct buf *bp;
+    int i;
+
+    jp = jfind(dev);
+    if (jp == NULL) {
+        return;
+    }
+    jlockup();
+    for (i = 0; i < jp->j_nblk; i++) {
+        if (jp->j_blkno[i] == bno) {
+            jp->j_blkno[i] = jp->j_blkno[--jp->j_nblk];
+            bp = incore(dev, bno);
+            if (bp) {
+                bp->b_flags &= ~B_JLOG;
+            }
+            break;
+        }
+    }
+    for (i = 0; i < jp->j_npass; i++) {
+        if (jp->j_pass[i] == bno) {
+            jcheckpoint(jp);
+            break;
+        }
+    }
+    junlock();
+}
+
+/*
+ * jcommit - Put the caller's changes on the log
+ *
+ * This is group commit: a caller that finds a commit already
+ * writing waits for it and then commits everything logged
+ * meanwhile, its own changes and those of any other waiters,
+ * unless one of them has done so first.
+ */
+void jcommit(dev_t dev) {
+    struct journal *jp;
+    uint32_t seq;
+
+    jp = jfind(dev);
+    if (jp == NULL) {
+        return;
+    }
+    seq = jp->j_seq;
+    while (jlock) {
+        sleep(&jlock, PRIBIO);
+    }
+    if (jp->j_cseq >= seq) {
+        return;
+    }
+    jdrain(jp);
+}
+
+/*
+ * jflush - Commit every journal no operation is using
+ * Used when the buffer cache is full of held blocks; it
+ * cannot wait for operations, as the caller may be in one.
+ * Returns the number of journals committed.
+ */
+int jflush(void) {
+    struct journal *jp;
+    int n;
+
+    n = 0;
+    for (jp = &journal[0]; jp < &journal[NMOUNT]; jp++) {
+        if (jp->j_end != 0 && jp->j_nactive == 0 && jp->j_nblk > 0) {
+            jdrain(jp);
+            n++;
+        }
+    }
+    return n;
+}
@@ -26,6 +26,8 @@ extern void brelse(struct buf *bp);
 extern daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg);
 extern int fubyte(caddr_t addr);
 extern void bcopy(const void *src, void *dst, int count);
+extern int dxisdir(struct inode *dp);
+extern ino_t dxlookup(struct inode *dp);
 
 /*
  * schar - Return the next character from a kernel string
@@ -137,16 +139,20 @@ cloop:
      */
     cp = u.u_dbuf;
     while (c != '/' && c != '\0' && u.u_error == 0) {
-        if (cp < &u.u_dbuf[DIRSIZ]) {
+        if (cp < &u.u_dbuf[MAXNAMLEN]) {
             *cp++ = c;
+        } else {
+            u.u_error = ENAMETOOLONG;
         }
         c = (*func)();
     }
+    u.u_namlen = cp - u.u_dbuf;
     
-    /* Pad with nulls */
+    /* Pad with nulls (V6 entries compare all DIRSIZ bytes) */
     while (cp < &u.u_dbuf[DIRSIZ]) {
         *cp++ = '\0';
     }
+    *cp = '\0';
     
     /* Skip any trailing slashes */
     while (c == '/') {
@@ -157,13 +163,28 @@ cloop:
         goto out;
     }
     
+    /*
+     * A hashed directory is searched through its index;
+     * only the leaf for the name's bucket is read.
+     */
+    eo = 0;
+    if (dxisdir(dp)) {
+        u.u_dent.u_ino = dxlookup(dp);
+        if (u.u_error) {
+            goto out;
+        }
+        if (u.u_dent.u_ino == 0) {
+            goto nomatch;
+        }
+        goto found;
+    }
+    
     /*
      * Set up to search a directory.
      */
     u.u_offset[0] = 0;
     u.u_offset[1] = 0;
     u.u_segflg = 1;  /* Kernel space */
-    eo = 0;
     u.u_count = (dp->i_size1 + (dp->i_size0 << 16)) / (DIRSIZ + 2);
     bp = NULL;
 
@@ -178,6 +199,7 @@ eloop:
             brelse(bp);
         }
         
+nomatch:
         if (flag == 1 && c == '\0') {
             /* Creating - check write permission */
             if (access(dp, IWRITE)) {
@@ -248,6 +270,7 @@ eloop:
         brelse(bp);
     }
     
+found:
     if (flag == 2 && c == '\0') {
         /* Deleting - check write permission */
         if (access(dp, IWRITE)) {
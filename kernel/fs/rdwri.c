@@ -10,9 +10,11 @@
 #include "include/param.h"
 #include "include/user.h"
 #include "include/inode.h"
+#include "include/filsys.h"
 #include "include/buf.h"
 #include "include/conf.h"
 #include "include/systm.h"
+#include "include/journal.h"
 
 /* External declarations */
 extern struct user u;
@@ -21,12 +23,16 @@ extern blkno_t rablock;
 extern time_t time[];
 extern struct buf *bread(dev_t dev, daddr_t blkno);
 extern struct buf *breada(dev_t dev, daddr_t blkno, daddr_t rablkno);
+extern int bprefetch(dev_t dev, daddr_t blkno);
+extern void bforget(dev_t dev, daddr_t blkno);
 extern struct buf *getblk(dev_t dev, daddr_t blkno);
 extern void brelse(struct buf *bp);
 extern void bwrite(struct buf *bp);
 extern void bawrite(struct buf *bp);
 extern void bdwrite(struct buf *bp);
 extern daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg);
+extern struct mount mount[];
+extern void bcopy(const void *src, void *dst, int count);
 
 /*
  * Forward declarations
@@ -62,6 +68,116 @@ static uint32_t isize(struct inode *ip) {
     return ((uint32_t)(ip->i_size0 & 0xFF) << 16) | ip->i_size1;
 }
 
+/*
+ * iatime - Record an access to a file, as its mount allows
+ *
+ * With noatime the time is never changed.  With relatime it
+ * is changed only if it is no later than the last change to
+ * the file, or a day old, so a file read over and over is not
+ * written back each time.
+ */
+void iatime(struct inode *ip) {
+    struct mount *mp;
+    
+    for (mp = &mount[0]; mp < &mount[NMOUNT]; mp++) {
+        if (mp->m_bufp != NULL && mp->m_dev == ip->i_dev) {
+            if (mp->m_flags & MNT_NOATIME) {
+                return;
+            }
+            if ((mp->m_flags & MNT_RELATIME) &&
+                ip->i_atime > ip->i_mtime && ip->i_atime > ip->i_ctime &&
+                time[1] - ip->i_atime < 24 * 60 * 60) {
+                return;
+            }
+            break;
+        }
+    }
+    ip->i_flag |= IACC;
+    ip->i_atime = time[1];
+}
+
+/*
+ * rmap - Find where block lbn of a file is cached or on disk
+ *
+ * Returns 0 for a hole, a block still waiting for a disk
+ * block, or one past the end of the file.
+ */
+static daddr_t rmap(struct inode *ip, daddr_t lbn, dev_t *devp) {
+    daddr_t bn;
+    
+    if ((ip->i_mode & IFMT) == IFBLK) {
+        *devp = ip->i_addr[0];
+        return lbn;
+    }
+    if (lbn >= (daddr_t)((isize(ip) + BMASK) >> BSHIFT)) {
+        return 0;
+    }
+    *devp = ip->i_dev;
+    bn = bmap(ip, lbn, 0);
+    return bn == (daddr_t)-1 ? 0 : bn;
+}
+
+/*
+ * rahead - Start reads of up to n blocks of a file from lbn on
+ * Returns the number of reads started.
+ */
+int rahead(struct inode *ip, daddr_t lbn, int n) {
+    daddr_t bn;
+    dev_t dev;
+    int started;
+    
+    started = 0;
+    if ((ip->i_mode & IFMT) == IFCHR) {
+        return 0;
+    }
+    for (; n > 0; lbn++, n--) {
+        if ((bn = rmap(ip, lbn, &dev)) != 0) {
+            started += bprefetch(dev, bn);
+        }
+    }
+    return started;
+}
+
+/*
+ * idrop - Drop up to n blocks of a file from lbn on from the cache
+ *
+ * Only clean buffers nobody is using go; dirty ones are
+ * left for the update daemon.
+ */
+void idrop(struct inode *ip, daddr_t lbn, int n) {
+    daddr_t bn;
+    dev_t dev;
+    
+    if ((ip->i_mode & IFMT) == IFCHR) {
+        return;
+    }
+    for (; n > 0; lbn++, n--) {
+        if ((bn = rmap(ip, lbn, &dev)) != 0) {
+            bforget(dev, bn);
+        }
+    }
+}
+
+/*
+ * iovnext - Step to the next non-empty segment of a readv
+ * or writev vector
+ *
+ * readi and writei call it when u_count runs out, so a whole
+ * vector is moved in one pass.  Returns 0 if there is none.
+ */
+int iovnext(void) {
+    while (u.u_iovcnt > 0) {
+        u.u_base = u.u_iov->iov_base;
+        u.u_count = u.u_iov->iov_len;
+        u.u_iov++;
+        u.u_iovcnt--;
+        if (u.u_count != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /*
  * readi - Read the file corresponding to the inode
  *
@@ -69,6 +185,7 @@ static uint32_t isize(struct inode *ip) {
  *   u_base   - core address for destination
  *   u_offset - byte offset in file
  *   u_count  - number of bytes to read
+ *   u_iov    - further segments, for readv
  *   u_segflg - read to kernel/user
  */
 void readi(struct inode *ip) {
@@ -78,15 +195,16 @@ void readi(struct inode *ip) {
     dev_t dev;
     uint32_t fsize;
     int32_t remaining;
+    int dx;
     
-    if (u.u_count == 0) {
+    if (u.u_count == 0 && !iovnext()) {
         return;
     }
     
-    ip->i_flag |= IACC;
-    ip->i_atime = time[1];
+    iatime(ip);
+    dx = (ip->i_mode & IFMT) == IFDIR ? dxisdir(ip) : 0;
     
-    /* Character device */
+    /* Character device - one segment, as a terminal gives one line */
     if ((ip->i_mode & IFMT) == IFCHR) {
         dev_t cdev = ip->i_addr[0];
         if (cdevsw[major(cdev)].d_read) {
@@ -111,6 +229,14 @@ void readi(struct inode *ip) {
             }
             n = min(n, remaining);
             
+            /* Data still waiting for a block is only in the cache */
+            bp = dafind(ip, lbn);
+            if (bp != NULL) {
+                iomove(bp, on, n, B_READ);
+                brelse(bp);
+                continue;
+            }
+            
             bn = bmap(ip, lbn, 0);
             if (bn == 0 || bn == (daddr_t)-1) {
                 return;
@@ -124,23 +250,42 @@ void readi(struct inode *ip) {
         }
         
         /* Read block, with read-ahead for sequential access */
-        if (ip->i_lastr + 1 == lbn) {
+        if (ip->i_lastr + 1 == lbn && ip->i_advice != FADV_RANDOM) {
+            if ((ip->i_mode & IFMT) != IFBLK) {
+                rablock = bmap(ip, lbn + 1, 0);
+                if (rablock == (daddr_t)-1) {
+                    rablock = 0;
+                }
+            }
             bp = breada(dev, bn, rablock);
+            if (ip->i_advice == FADV_SEQUENTIAL) {
+                rahead(ip, lbn + 2, NRAHEAD - 1);
+            }
         } else {
             bp = bread(dev, bn);
         }
         
-        ip->i_lastr = lbn;
-        
         if (bp == NULL || (bp->b_flags & B_ERROR)) {
+            ip->i_lastr = lbn;
             if (bp) brelse(bp);
             return;
         }
         
+        /* A directory read in order is likely being listed */
+        if ((ip->i_mode & IFMT) == IFDIR && ip->i_lastr + 1 == lbn) {
+            dirprefetch(ip, bp, lbn, dx);
+        }
+        ip->i_lastr = lbn;
+        
         iomove(bp, on, n, B_READ);
         brelse(bp);
         
-    } while (u.u_error == 0 && u.u_count != 0);
+        /* A block read through once is not kept in the way of others */
+        if (ip->i_advice == FADV_NOREUSE && on + n == BSIZE) {
+            bforget(dev, bn);
+        }
+        
+    } while (u.u_error == 0 && (u.u_count != 0 || iovnext()));
 }
 
 /*
@@ -150,11 +295,12 @@ void readi(struct inode *ip) {
  *   u_base   - core address for source
  *   u_offset - byte offset in file
  *   u_count  - number of bytes to write
+ *   u_iov    - further segments, for writev
  *   u_segflg - write from kernel/user
  */
 void writei(struct inode *ip) {
     struct buf *bp;
-    daddr_t bn;
+    daddr_t bn, nb;
     int on, n;
     dev_t dev;
     uint32_t newsize;
@@ -167,12 +313,21 @@ void writei(struct inode *ip) {
     if ((ip->i_mode & IFMT) == IFCHR) {
         dev_t cdev = ip->i_addr[0];
         if (cdevsw[major(cdev)].d_write) {
-            (*cdevsw[major(cdev)].d_write)(cdev);
+            do {
+                (*cdevsw[major(cdev)].d_write)(cdev);
+            } while (u.u_error == 0 && u.u_count == 0 && iovnext());
         }
         return;
     }
     
-    if (u.u_count == 0) {
+    if (u.u_count == 0 && !iovnext()) {
+        return;
+    }
+    
+    /* Earlier data lost when its blocks were allocated for it */
+    if (ip->i_error) {
+        u.u_error = ip->i_error;
+        ip->i_error = 0;
         return;
     }
     
@@ -182,7 +337,22 @@ void writei(struct inode *ip) {
         on = u.u_offset[1] & BMASK;
         n = min(BSIZE - on, u.u_count);
         
-        if ((ip->i_mode & IFMT) != IFBLK) {
+        bp = NULL;
+        if ((ip->i_mode & IFMT) == IFREG) {
+            /* New blocks of a regular file are allocated at writeback */
+            nb = bmap(ip, bn, 0);
+            if (nb == 0 || nb == (daddr_t)-1) {
+                bp = dagetblk(ip, bn);
+            }
+            if (bp != NULL && (bp->b_flags & B_DONE) == 0) {
+                clrbuf(bp);
+                bp->b_flags |= B_DONE;
+            }
+        }
+        
+        if (bp != NULL) {
+            dev = ip->i_dev;
+        } else if ((ip->i_mode & IFMT) != IFBLK) {
             bn = bmap(ip, bn, 1);  /* Allocate if needed */
             if (bn == 0 || bn == (daddr_t)-1) {
                 return;
@@ -193,7 +363,9 @@ void writei(struct inode *ip) {
         }
         
         /* Get buffer - full block write doesn't need read */
-        if (n == BSIZE) {
+        if (bp != NULL) {
+            /* Already have the delayed-allocation buffer */
+        } else if (n == BSIZE) {
             bp = getblk(dev, bn);
         } else {
             bp = bread(dev, bn);
@@ -206,13 +378,18 @@ void writei(struct inode *ip) {
         
         iomove(bp, on, n, B_WRITE);
         
-        if (u.u_error != 0) {
+        if (u.u_error != 0 || (bp->b_flags & B_DELALLOC)) {
+            /* A delayed-allocation buffer stays dirty until it gets a block */
             brelse(bp);
+        } else if ((ip->i_mode & IFMT) == IFDIR && jlog(bp)) {
+            /* Directory blocks are metadata, held for the journal */
         } else if ((u.u_offset[1] & BMASK) == 0) {
             /* Block boundary - write asynchronously */
+            bown(bp, ip);
             bawrite(bp);
         } else {
             /* Partial block - delayed write */
+            bown(bp, ip);
             bdwrite(bp);
         }
         
@@ -222,12 +399,89 @@ void writei(struct inode *ip) {
             if (newsize > isize(ip)) {
                 ip->i_size0 = (newsize >> 16) & 0xFF;
                 ip->i_size1 = newsize & 0xFFFF;
+                ip->i_flag |= ISIZE;
             }
         }
         
         ip->i_flag |= IUPD;
         
-    } while (u.u_error == 0 && u.u_count != 0);
+    } while (u.u_error == 0 && (u.u_count != 0 || iovnext()));
+}
+
+/*
+ * copyi - Copy count bytes from one regular file to another
+ *
+ * Each source block is read into the cache, with read-ahead
+ * when reading in order, and handed straight to writei, so
+ * the data moves from cache buffer to cache buffer and never
+ * through the user.  The destination gets its blocks through
+ * delayed allocation, in runs.  A block copied within one file
+ * goes through a spare buffer, since writei may want the very
+ * block being copied from.  A regular file written to must
+ * be locked by the caller.  Returns the number of bytes copied.
+ */
+int copyi(struct inode *sip, off_t soff, struct inode *dip, off_t doff, int count) {
+    struct buf *bp, *tp;
+    daddr_t lbn, bn, rabn;
+    int on, n, done;
+    uint32_t fsize;
+    
+    iatime(sip);
+    fsize = isize(sip);
+    done = 0;
+    
+    while (count > 0 && u.u_error == 0 && (uint32_t)soff < fsize) {
+        lbn = soff >> BSHIFT;
+        on = soff & BMASK;
+        n = min(min(BSIZE - on, count), fsize - soff);
+        
+        bp = dafind(sip, lbn);
+        if (bp == NULL) {
+            bn = bmap(sip, lbn, 0);
+            if (bn == 0 || bn == (daddr_t)-1) {
+                break;
+            }
+            if (sip->i_lastr + 1 == lbn && sip->i_advice != FADV_RANDOM) {
+                rabn = bmap(sip, lbn + 1, 0);
+                bp = breada(sip->i_dev, bn, rabn == (daddr_t)-1 ? 0 : rabn);
+                if (sip->i_advice == FADV_SEQUENTIAL) {
+                    rahead(sip, lbn + 2, NRAHEAD - 1);
+                }
+            } else {
+                bp = bread(sip->i_dev, bn);
+            }
+            sip->i_lastr = lbn;
+            if (bp->b_flags & B_ERROR) {
+                brelse(bp);
+                break;
+            }
+        }
+        if (sip == dip) {
+            tp = getblk(NODEV, 0);
+            bcopy(bp->b_addr + on, tp->b_addr, n);
+            brelse(bp);
+            bp = tp;
+            on = 0;
+        }
+        
+        u.u_base = bp->b_addr + on;
+        u.u_count = n;
+        u.u_segflg = 1;
+        u.u_offset[0] = 0;
+        u.u_offset[1] = doff;
+        writei(dip);
+        brelse(bp);
+        
+        n -= u.u_count;
+        soff += n;
+        doff += n;
+        done += n;
+        count -= n;
+        if (u.u_count != 0) {
+            break;
+        }
+    }
+    return done;
 }
 
 /*
@@ -9,6 +9,8 @@
 #include "param.h"
 #include "types.h"
 
+struct inode;
+
 /*
  * Each buffer in the pool is usually doubly linked into 2 lists:
  * - The device with which it is currently associated (always)
@@ -31,6 +33,8 @@ struct buf {
     blkno_t     b_blkno;        /* Block number on device */
     int8_t      b_error;        /* Error returned after I/O */
     uint32_t    b_resid;        /* Words not transferred after error */
+    struct inode *b_ip;         /* File whose dirty block this is */
+    struct buf  *b_dnext;       /* Next on the file's dirty list */
 };
 
 /*
@@ -60,6 +64,8 @@ struct devtab {
 #define B_RELOC     0200        /* Unused (was relocation) */
 #define B_ASYNC     0400        /* Don't wait for I/O completion */
 #define B_DELWRI    01000       /* Delayed write - don't write till reassign */
+#define B_JLOG      02000       /* Held until its journal transaction commits */
+#define B_DELALLOC  04000       /* File data with no disk block yet */
 
 /* Global buffer structures */
 extern struct buf buf[NBUF];        /* Buffer headers */
@@ -72,6 +78,8 @@ extern struct buf swbuf;            /* Buffer for swapping */
  */
 struct buf *bread(dev_t dev, blkno_t blkno);
 struct buf *breada(dev_t dev, blkno_t blkno, blkno_t rablkno);
+int bprefetch(dev_t dev, daddr_t blkno);
+void bforget(dev_t dev, daddr_t blkno);
 struct buf *getblk(dev_t dev, blkno_t blkno);
 void bwrite(struct buf *bp);
 void bdwrite(struct buf *bp);
@@ -79,6 +87,17 @@ void bawrite(struct buf *bp);
 void brelse(struct buf *bp);
 void clrbuf(struct buf *bp);
 struct buf *incore(dev_t dev, blkno_t blkno);
+void bassign(struct buf *bp, dev_t dev, daddr_t blkno);
+struct buf *dafind(struct inode *ip, daddr_t lbn);
+struct buf *dagetblk(struct inode *ip, daddr_t lbn);
+void dalloc(struct inode *ip);
+int dtryalloc(struct inode *ip);
+void dinval(struct inode *ip);
+void bown(struct buf *bp, struct inode *ip);
+void bdisown(struct buf *bp);
+void bdetach(struct inode *ip);
+void bsyncip(struct inode *ip);
+void bflush(dev_t dev);
 void binit(void);
 void iowait(struct buf *bp);
 void notavail(struct buf *bp);
@@ -31,6 +31,9 @@ struct file {
 #define FAPPEND     010         /* Append on each write */
 #define FNONBLOCK   020         /* Non-blocking I/O */
 
+/* fallocate modes */
+#define FALLOC_FL_KEEP_SIZE 01  /* Allocate without changing the size */
+
 /* Global file table */
 extern struct file file[NFILE];
 
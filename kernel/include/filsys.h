@@ -27,12 +27,17 @@ struct filsys {
     int8_t      s_fmod;         /* Superblock modified flag */
     int8_t      s_ronly;        /* Mounted read-only flag */
     time_t      s_time[2];      /* Last super block update (64-bit time) */
-    /* Padding to fill 512-byte block */
+    daddr_t     s_jstart;       /* First block of journal region */
+    daddr_t     s_jsize;        /* Blocks in journal, 0 if none */
+    /* Padding to fill 512-byte block (6 bytes of alignment holes above) */
     char        s_pad[512 - sizeof(uint16_t) - sizeof(daddr_t) - sizeof(int16_t) - 
                       (NICFREE * sizeof(daddr_t)) - sizeof(int16_t) - (NICINOD * sizeof(ino_t)) - 
-                      4 - (2 * sizeof(time_t))];
+                      4 - (2 * sizeof(time_t)) - (2 * sizeof(daddr_t)) - 6];
 };
 
+/* Ensure the superblock occupies exactly one block */
+typedef char filsys_size_check[(sizeof(struct filsys) == BSIZE) ? 1 : -1];
+
 /*
  * Structure of an on-disk inode (32 bytes in V6)
  * Must match exactly what's written to disk.
@@ -57,6 +62,92 @@ struct direct {
     char        d_name[DIRSIZ]; /* Filename */
 };
 
+/*
+ * Hashed directory format.
+ *
+ * Block 0 is a header whose first two bytes are zero, so a
+ * V6 reader sees an empty slot.  The header maps each hash
+ * bucket to the leaf block holding its names; adjacent buckets
+ * share a leaf until it fills and is split in half.  A leaf
+ * serving a single bucket grows by chaining overflow blocks.
+ *
+ * Leaves hold variable length entries which together cover
+ * the whole block; a deleted entry is folded into its
+ * predecessor, or has d_ino cleared if it is first.
+ */
+#define DXMAGIC     0x7844      /* Header magic ("Dx") */
+#define DXNBUCKET   248         /* Hash buckets in the header block */
+
+struct dxhead {
+    ino_t       dh_zero;        /* Always 0 (empty V6 slot) */
+    uint16_t    dh_magic;       /* DXMAGIC */
+    uint16_t    dh_nbucket;     /* Number of buckets in use */
+    uint16_t    dh_pad[5];
+    uint16_t    dh_bucket[DXNBUCKET]; /* Leaf block for each bucket */
+};
+
+struct dxleaf {
+    uint16_t    dl_next;        /* Overflow block, 0 if none */
+    uint16_t    dl_pad;
+};
+
+struct ldirect {
+    ino_t       d_ino;          /* Inode number, 0 if unused */
+    uint16_t    d_reclen;       /* Bytes to the next entry */
+    uint8_t     d_namlen;       /* Length of d_name */
+    uint8_t     d_type;         /* DT_* file type */
+    char        d_name[MAXNAMLEN+1]; /* Name, not NUL terminated */
+};
+
+#define LDIRHDR     6           /* Bytes before d_name */
+#define LDIRSIZ(n)  ((LDIRHDR + (n) + 3) & ~3)
+
+/*
+ * Entry returned by getdents.  Records are packed back to
+ * back, each a multiple of 4 bytes long; d_off is the
+ * directory offset to resume from after this entry.
+ */
+struct gdirent {
+    uint32_t    d_ino;          /* Inode number */
+    uint32_t    d_off;          /* Offset of the next entry */
+    uint16_t    d_reclen;       /* Bytes to the next record */
+    uint8_t     d_namlen;       /* Length of d_name */
+    uint8_t     d_type;         /* DT_* file type */
+    char        d_name[MAXNAMLEN+1]; /* Name, NUL terminated */
+};
+
+#define GDIRHDR     12          /* Bytes before d_name */
+#define GDIRSIZ(n)  ((GDIRHDR + (n) + 1 + 3) & ~3)
+
+/*
+ * Entry returned by readdirplus: the file's status, laid
+ * out as stat returns it, then a gdirent whose d_reclen
+ * covers both.
+ */
+struct pdirstat {
+    dev_t       p_dev;          /* Device */
+    ino_t       p_ino;          /* Inode number */
+    mode_t      p_mode;         /* Mode */
+    uint16_t    p_nlink;        /* Link count */
+    uid_t       p_uid;          /* User ID */
+    gid_t       p_gid;          /* Group ID */
+    dev_t       p_rdev;         /* Device, for special files */
+    uint16_t    p_pad;
+    uint32_t    p_size;         /* Size in bytes */
+    time_t      p_atime;        /* Last access time */
+    time_t      p_mtime;        /* Last modification time */
+    time_t      p_ctime;        /* Last status change time */
+};
+
+#define PDIRSIZ(n)  (sizeof(struct pdirstat) + GDIRSIZ(n))
+
+/* File types kept in d_type */
+#define DT_UNKNOWN  0
+#define DT_CHR      2
+#define DT_DIR      4
+#define DT_BLK      6
+#define DT_REG      8
+
 /*
  * Filesystem function prototypes
  */
@@ -65,4 +156,20 @@ struct buf *alloc(dev_t dev);
 void bfree(dev_t dev, daddr_t bno);
 int badblock(struct filsys *fp, daddr_t bno, dev_t dev);
 
+/*
+ * Directory function prototypes (fs/dir.c)
+ */
+struct inode;
+struct buf;
+int dxisdir(struct inode *dp);
+ino_t dxlookup(struct inode *dp);
+int dxenter(struct inode *dp, struct inode *ip);
+void dxremove(struct inode *dp);
+int dxinit(struct inode *dp, ino_t parent);
+void dirprefetch(struct inode *dp, struct buf *bp, int lbn, int dx);
+int dirread(struct inode *dp, off_t *offp, ino_t *inop, char *name, int *typep);
+ino_t dirfind(struct inode *dp, const char *name);
+int dirrepoint(struct inode *dp, const char *name, ino_t ino);
+void dirremove(void);
+
 #endif /* _FILSYS_H_ */
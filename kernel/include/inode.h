@@ -9,6 +9,8 @@
 #include "param.h"
 #include "types.h"
 
+struct buf;
+
 /*
  * The inode is the focus of all file activity in Unix.
  * There is a unique inode allocated for each active file,
@@ -19,7 +21,7 @@
  * Data from mode onwards is read from the permanent inode on volume.
  */
 struct inode {
-    int8_t      i_flag;         /* Inode flags */
+    uint8_t     i_flag;         /* Inode flags */
     int8_t      i_count;        /* Reference count */
     dev_t       i_dev;          /* Device where inode resides */
     ino_t       i_number;       /* Inode number (1-to-1 with disk address) */
@@ -34,6 +36,9 @@ struct inode {
     time_t      i_atime;        /* Last access time */
     time_t      i_mtime;        /* Last modification time */
     time_t      i_ctime;        /* Last status change time */
+    struct buf  *i_dirtyb;      /* Dirty buffers holding its blocks */
+    uint8_t     i_advice;       /* Access pattern given by fadvise */
+    int8_t      i_error;        /* Error allocating its data behind its back */
 };
 
 /* Inode flags */
@@ -44,6 +49,15 @@ struct inode {
 #define IWANT       020         /* Some process waiting on lock */
 #define ITEXT       040         /* Inode is pure text prototype */
 #define ICHG        0100        /* Inode metadata changed */
+#define ISIZE       0200        /* Size or block map changed (fdatasync) */
+
+/* Access patterns kept in i_advice */
+#define FADV_NORMAL     0       /* One block of read-ahead */
+#define FADV_RANDOM     1       /* No read-ahead */
+#define FADV_SEQUENTIAL 2       /* NRAHEAD blocks of read-ahead */
+#define FADV_WILLNEED   3       /* (Not kept) prefetch a range now */
+#define FADV_DONTNEED   4       /* (Not kept) drop a range from the cache */
+#define FADV_NOREUSE    5       /* Blocks read are reused first */
 
 /* File type and mode bits */
 #define IALLOC      0100000     /* File is used (allocated) */
@@ -73,7 +87,14 @@ extern struct inode *rootdir;
 struct inode *iget(dev_t dev, ino_t ino);
 void iput(struct inode *ip);
 void iupdat(struct inode *ip, time_t *tm);
+void iflush(dev_t dev);
+int iprefetch(dev_t dev, ino_t ino);
+int ipeek(dev_t dev, ino_t ino, struct inode *cp);
+void iatime(struct inode *ip);
+int rahead(struct inode *ip, daddr_t lbn, int n);
+void idrop(struct inode *ip, daddr_t lbn, int n);
 void itrunc(struct inode *ip);
+int iprealloc(struct inode *ip, daddr_t lbn, int n);
 struct inode *ialloc(dev_t dev);
 void ifree(dev_t dev, ino_t ino);
 struct inode *namei(int (*func)(void), int flag);
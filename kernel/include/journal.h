@@ -0,0 +1,92 @@
+/* journal.h - Unix V6 x86 Port Metadata Journal
+ * Write-ahead log of metadata blocks kept in a region
+ * named by the superblock
+ */
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include "param.h"
+#include "types.h"
+
+/*
+ * The first block of the region is a header naming the
+ * sequence number of the transaction expected in the block
+ * after it.  Transactions follow back to back, each as a
+ * descriptor, the logged blocks, and a commit record; a
+ * transaction whose commit record is missing or whose
+ * checksum is wrong ends the log.
+ */
+#define JMAGIC      0x4a483656  /* Header ("V6HJ") */
+#define JDESC       0x4a443656  /* Descriptor ("V6DJ") */
+#define JCOMMIT     0x4a433656  /* Commit record ("V6CJ") */
+
+#define JMAXBLK     16          /* Blocks logged per transaction */
+#define JRESV       8           /* Blocks reserved by an operation */
+#define JNOP        (JMAXBLK / JRESV)  /* Operations open at once */
+#define JMINSIZE    (2 * (JMAXBLK + 3))  /* Smallest usable region */
+#define JNPASS      128         /* Blocks remembered since the log started over */
+
+struct jhead {
+    uint32_t    jh_magic;       /* JMAGIC, JDESC or JCOMMIT */
+    uint32_t    jh_seq;         /* Transaction sequence number */
+    uint32_t    jh_count;       /* Blocks in the transaction */
+    uint32_t    jh_sum;         /* Checksum of the logged blocks */
+    daddr_t     jh_blkno[JMAXBLK + 1]; /* Home of each logged block */
+};
+
+/*
+ * An operation open on a journal.  No operation may log
+ * more than JRESV blocks; longer ones are split where what
+ * they have done so far stands on its own (see jrestart).
+ */
+struct jop {
+    struct proc *jo_proc;       /* Process in it, NULL if the slot is free */
+    int8_t      jo_nest;        /* Depth of jbegin calls */
+    int8_t      jo_nlog;        /* Blocks it added to the transaction */
+};
+
+/*
+ * In-core journal, one for each mounted file system
+ * that has a journal region.
+ */
+struct journal {
+    dev_t       j_dev;          /* Device, valid while j_end != 0 */
+    daddr_t     j_start;        /* Header block of the region */
+    daddr_t     j_end;          /* First block past the region */
+    daddr_t     j_pos;          /* Where the next transaction goes */
+    uint32_t    j_seq;          /* Sequence of the running transaction */
+    uint32_t    j_cseq;         /* Last transaction on the log */
+    int16_t     j_nactive;      /* Operations in the running transaction */
+    int16_t     j_nres;         /* Blocks reserved in it */
+    int16_t     j_want;         /* Commits waiting for the operations to finish */
+    struct jop  j_op[JNOP];     /* The operations open */
+    int16_t     j_nblk;         /* Blocks in the running transaction */
+    daddr_t     j_blkno[JMAXBLK]; /* Blocks logged by it */
+    int16_t     j_npass;        /* Blocks with copies on the log */
+    daddr_t     j_pass[JNPASS]; /* Their numbers, for jrevoke */
+};
+
+extern struct journal journal[NMOUNT];
+
+struct buf;
+struct filsys;
+struct proc;
+
+/*
+ * Journal function prototypes (fs/journal.c)
+ */
+struct journal *jfind(dev_t dev);
+int jinit(dev_t dev, struct filsys *fp);
+void jclose(dev_t dev);
+void jbegin(dev_t dev);
+void jend(dev_t dev);
+int jlog(struct buf *bp);
+void jrevoke(dev_t dev, daddr_t bno);
+void jcommit(dev_t dev);
+int jflush(void);
+void jrestart(dev_t dev);
+int jroom(dev_t dev, int n);
+int jactive(void);
+
+#endif /* _JOURNAL_H_ */
@@ -13,7 +13,10 @@
  * Original values preserved where possible
  */
 
-#define NBUF        15          /* Size of buffer cache */
+#define NBUF        32          /* Size of buffer cache */
+#define NDALLOC     (NBUF/4)    /* Buffers awaiting block allocation */
+#define NRAHEAD     (NBUF/4)    /* Read-ahead window of a sequential file */
+#define NWILLNEED   (NBUF/2)    /* Blocks one fadvise or readahead prefetches */
 #define NINODE      100         /* Number of in-core inodes */
 #define NFILE       100         /* Number of in-core file structures */
 #define NMOUNT      5           /* Number of mountable file systems */
@@ -22,9 +25,12 @@
 #define SSIZE       20          /* Initial stack size (*64 bytes) */
 #define SINCR       20          /* Increment of stack (*64 bytes) */
 #define NOFILE      15          /* Max open files per process */
+#define NIOV        16          /* Max segments in a readv/writev vector */
 #define CANBSIZ     256         /* Max size of typewriter line */
 #define CMAPSIZ     100         /* Size of core allocation area */
 #define SMAPSIZ     100         /* Size of swap allocation area */
+#define SWPLO       32768       /* First swap block on the IDE disk */
+#define NSWAP       32768       /* Swap blocks, from SWPLO on */
 #define NCALL       20          /* Max simultaneous time callouts */
 #define NPROC       50          /* Max number of processes */
 #define NTEXT       40          /* Max number of pure texts */
@@ -74,6 +80,8 @@
 #define USIZE_BYTES (USIZE * 64)
 #define ROOTINO     1           /* I-number of all roots */
 #define DIRSIZ      14          /* Max characters per directory name */
+#define MAXNAMLEN   255         /* Max name length in a hashed directory */
+#define CWDLEN      128         /* Longest current directory path cached */
 
 /*
  * File system constants
@@ -37,15 +37,17 @@ struct proc {
     uint16_t    p_umask;        /* File creation mask */
     uint16_t    p_sigmask;      /* Signal mask (bitset) */
     uint16_t    p_exit;         /* Exit status for wait() */
-    uint32_t    p_addr;         /* Address of swappable image */
+    uint16_t    p_xerr;         /* Error of a spawn that failed before exec */
+    uint32_t    p_addr;         /* Core address of u-area (in 64-byte units) */
     uint32_t    p_size;         /* Size of swappable image (in 64-byte units) */
+    uint32_t    p_brk;          /* Part of p_size the break needs; the rest is reserve */
     uint32_t    p_wchan;        /* Event process is awaiting */
     struct text *p_textp;       /* Pointer to text structure */
 
     /* x86 additions for context switch */
     uint32_t    p_esp;          /* Saved stack pointer */
     uint32_t    p_ebp;          /* Saved base pointer */
-    uint32_t    p_cr3;          /* Page directory (for future paging) */
+    uint32_t    p_cr3;          /* Physical address of page directory */
 };
 
 /* Process status codes */
@@ -64,6 +66,7 @@ struct proc {
 #define SSWAP       010         /* Process is being swapped out */
 #define STRC        020         /* Process is being traced */
 #define SWTED       040         /* Another tracing flag */
+#define SVFORK      0100        /* Borrowing the parent's image (vfork) */
 
 /* Global process table */
 extern struct proc proc[NPROC];
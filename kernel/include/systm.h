@@ -61,12 +61,21 @@ struct mount {
     dev_t       m_dev;          /* Device mounted */
     struct buf  *m_bufp;        /* Pointer to superblock buffer */
     struct inode *m_inodp;      /* Pointer to mounted-on inode */
+    int8_t      m_flags;        /* Mount options, below */
 };
 extern struct mount mount[NMOUNT];
 
+/* Mount options (third argument of mount) */
+#define MNT_RDONLY      01      /* Read-only */
+#define MNT_NOATIME     02      /* Never update access times */
+#define MNT_RELATIME    04      /* Update access times only when stale */
+
 /* Process ID generator */
 extern int mpid;
 
+/* Bumped when a directory is renamed or removed (stales u_cwd) */
+extern int cwdgen;
+
 /* Scheduling flags */
 extern int8_t runin;            /* Swap scheduler waiting */
 extern int8_t runout;           /* Swap scheduler waiting for space */
@@ -97,7 +106,7 @@ extern char regloc[];
 /*
  * System function prototypes
  */
-void panic(const char *msg);
+void panic(const char *msg) __attribute__((noreturn));
 void kprintf(const char *fmt, ...);
 void prdev(const char *msg, dev_t dev);
 void serial_init(void);
@@ -107,9 +116,12 @@ void sleep(void *chan, int pri);
 void setrun(struct proc *p);
 void setpri(struct proc *p);
 void swtch(void);
-void sched(void);
+void sched(void) __attribute__((noreturn));
 void expand(int newsize);
-int newproc(void);
+int grow(uint32_t sp);
+int newproc(int isvfork);
+void vfdone(uint32_t pd);
+struct proc *vfwait(int pid);
 void update_pos(struct proc *p);
 int issig(void);
 void psignal(struct proc *p, int sig);
@@ -118,7 +130,11 @@ int suser(void);
 void timeout(void (*func)(uint32_t), uint32_t arg, int ticks);
 void mfree(uint32_t *map, int size, uint32_t addr);
 uint32_t malloc(uint32_t *map, int size);
+int mgrow(uint32_t *map, uint32_t addr, int size);
+void coreinit(uint32_t addr, int size);
 void clearseg(uint32_t addr);
+void clearsegs(uint32_t addr, int n);
+void copysegs(uint32_t from, uint32_t to, int n);
 void bcopy(const void *from, void *to, int count);
 
 /*
@@ -11,7 +11,7 @@
 
 /*
  * Text structure.
- * One allocated per pure procedure on swap device.
+ * One allocated per pure procedure in core.
  * Manipulated by text.c
  *
  * Pure text segments are shared among processes running
@@ -19,7 +19,7 @@
  */
 struct text {
     daddr_t     x_daddr;        /* Disk address of segment */
-    daddr_t     x_caddr;        /* Core address, if loaded */
+    uint32_t    x_caddr;        /* Page holding the list of its pages, if loaded */
     uint32_t    x_size;         /* Size (*64 bytes) */
     struct inode *x_iptr;       /* Inode of prototype */
     int8_t      x_count;        /* Reference count */
@@ -38,8 +38,11 @@ extern struct text text[NTEXT];
 /*
  * Text function prototypes
  */
-struct text *xalloc(struct inode *ip);
+struct text *xalloc(struct inode *ip, uint32_t off, uint32_t size);
 void xfree(struct text *xp);
+void xrele(struct inode *ip);
+int xflush(void);
+void xumount(dev_t dev);
 void xccdec(struct text *xp);
 void xswap(struct proc *p, int osiz, int nisz, int osec);
 void xunlock(struct text *xp);
@@ -9,6 +9,32 @@
 #include "param.h"
 #include "types.h"
 
+/*
+ * A segment of a readv/writev vector, as the user passes it.
+ */
+struct iovec {
+    caddr_t     iov_base;       /* Start of the segment */
+    uint32_t    iov_len;        /* Its length in bytes */
+};
+
+/*
+ * A file action for spawn, applied in the child before exec.
+ * sa_arg is the new descriptor for SPAWN_DUP2, the open mode
+ * for SPAWN_OPEN and the file mode for SPAWN_CREAT; the file
+ * opened is moved to sa_fd.
+ */
+struct spawnact {
+    int         sa_type;        /* SPAWN_* */
+    int         sa_fd;          /* Descriptor acted on */
+    int         sa_arg;
+    caddr_t     sa_path;        /* File to open */
+};
+
+#define SPAWN_CLOSE 1
+#define SPAWN_DUP2  2
+#define SPAWN_OPEN  3
+#define SPAWN_CREAT 4
+
 /*
  * The user structure. One allocated per process.
  * Contains all per-process data that doesn't need to be
@@ -40,10 +66,13 @@ struct user {
     caddr_t     u_base;         /* Base address for IO */
     uint32_t    u_count;        /* Bytes remaining for IO */
     off_t       u_offset[2];    /* Offset in file for IO (64-bit) */
+    struct iovec *u_iov;        /* Segments after u_base, for readv/writev */
+    int32_t     u_iovcnt;       /* Number left in u_iov */
 
     /* Directory handling */
     struct inode *u_cdir;       /* Pointer to inode of current directory */
-    char        u_dbuf[DIRSIZ]; /* Current pathname component */
+    char        u_dbuf[MAXNAMLEN+1]; /* Current pathname component */
+    int16_t     u_namlen;       /* Length of name in u_dbuf */
     caddr_t     u_dirp;         /* Current pointer to pathname */
     struct {                    /* Current directory entry */
         ino_t   u_ino;
@@ -85,9 +114,13 @@ struct user {
     uint32_t    u_prof[4];      /* Profile arguments */
     int8_t      u_intflg;       /* Catch interrupt from sys */
 
+    /* Current directory path, kept by chdir for getcwd */
+    int32_t     u_cwdgen;       /* Value of cwdgen when u_cwd was set */
+    char        u_cwd[CWDLEN];  /* The path, "" if not known */
+
     /* Kernel stack grows down from end of user structure */
     /* Stack space sized so sizeof(struct user) == USIZE_BYTES */
-    uint8_t     u_stack[3468];
+    uint8_t     u_stack[3083];
 };
 
 /* Ensure the u-area occupies exactly USIZE_BYTES */
@@ -131,6 +164,7 @@ extern struct user u;
 #define EROFS       30          /* Read-only file system */
 #define EMLINK      31          /* Too many links */
 #define EPIPE       32          /* Broken pipe */
+#define ENAMETOOLONG 36         /* File name too long */
 #define ENOSYS      38          /* Function not implemented */
 
 #endif /* _USER_H_ */
@@ -0,0 +1,105 @@
+/* vm.h - Unix V6 x86 Port Paged Memory
+ * i386 two-level page tables, one page directory per process
+ */
+
+#ifndef _VM_H_
+#define _VM_H_
+
+#include "param.h"
+#include "types.h"
+
+#define PGSIZE      4096        /* Bytes in a page */
+#define PGSHIFT     12
+#define PGCLICK     (PGSIZE / 64) /* Core clicks in a page */
+#define PDSIZE      (1 << PDSHIFT) /* Bytes mapped by one directory entry */
+#define PDSHIFT     22
+#define NPTE        1024        /* Entries in a page table or directory */
+
+#define PDX(la)     ((uint32_t)(la) >> PDSHIFT)
+#define PTX(la)     (((uint32_t)(la) >> PGSHIFT) & (NPTE - 1))
+#define pground(n)  (((uint32_t)(n) + PGSIZE - 1) & ~(PGSIZE - 1))
+
+/*
+ * User virtual address 0 is linear USERBASE; the user code
+ * and data segments start there and end USERSIZE bytes later.
+ * The rest of the linear space belongs to the kernel, which
+ * maps physical memory 1:1 with 4MB pages.  Those directory
+ * entries are set up once at boot and copied into every page
+ * directory, so all processes share the kernel map.
+ */
+#define USERBASE    0x40000000U
+#define USERSIZE    0x40000000U
+
+/*
+ * Text, data and the heap start at user address 0 and grow
+ * up; the stack ends at USERSIZE and grows down a page at a
+ * time, to at most STKMAX clicks.  The heap is kept out of
+ * that range.
+ */
+#define STKMAX      (256 * PGCLICK)
+
+/* Page table entry bits */
+#define PG_P        0x001       /* Present */
+#define PG_W        0x002       /* Writable */
+#define PG_U        0x004       /* User accessible */
+#define PG_PS       0x080       /* 4MB page (directory entry) */
+#define PG_COW      0x200       /* Read-only until copied (free for software) */
+#define PG_SWAP     0x400       /* Not present, frame holds swap block (software) */
+#define PG_FRAME    0xFFFFF000
+
+/* Process memory is handed out a page at a time from coremap */
+typedef char usize_check[(USIZE % PGCLICK) == 0 ? 1 : -1];
+
+#define PGBLK       (PGSIZE / BSIZE) /* Swap blocks in a page */
+
+typedef uint32_t pte_t;
+
+/*
+ * Core allocator statistics, returned by memstat.  The
+ * largest free block and how much free core lies in small
+ * blocks show how fragmented core is.  The swap counts
+ * show how much traffic each swap transfer carries.
+ */
+#define MSNORD      16
+
+struct memstat {
+    uint32_t    ms_total;       /* Pages of core managed */
+    uint32_t    ms_free;        /* Pages free */
+    uint32_t    ms_nalloc;      /* Allocations made */
+    uint32_t    ms_nfail;       /* Allocations refused */
+    uint32_t    ms_nreclaim;    /* Pages taken back by vmreclaim */
+    uint32_t    ms_nblk[MSNORD]; /* Free blocks of 2^k pages */
+    uint32_t    ms_nswout;      /* Processes swapped out */
+    uint32_t    ms_nswin;       /* Processes swapped in */
+    uint32_t    ms_pgout;       /* Pages written to swap */
+    uint32_t    ms_pgin;        /* Pages read from swap */
+    uint32_t    ms_nswio;       /* Swap transfers */
+};
+
+extern struct memstat corestat;
+
+extern pte_t kpgdir[NPTE];
+
+/*
+ * Paging function prototypes (vm.c)
+ */
+void vminit(void);
+void lcr3(uint32_t pd);
+uint32_t rcr2(void);
+uint32_t pgalloc(void);
+void pgfree(uint32_t pa);
+uint32_t vtop(uint32_t pd, uint32_t va);
+int vmmap(uint32_t pd, uint32_t va, uint32_t eva);
+void vmunmap(uint32_t pd, uint32_t va, uint32_t eva);
+int vmcow(uint32_t pd, uint32_t va);
+int vmshare(uint32_t pd, uint32_t va, uint32_t pa);
+uint32_t vmdup(uint32_t pd);
+void vmfree(uint32_t pd);
+int vmreclaim(void);
+
+struct proc;
+int vmswapok(struct proc *p);
+int vmswapout(struct proc *p);
+int vmswapin(struct proc *p);
+
+#endif /* _VM_H_ */
@@ -18,6 +18,7 @@
 #include "include/file.h"
 #include "include/conf.h"
 #include "include/reg.h"
+#include "include/vm.h"
 
 /*
  * Icode is the bootstrap program executed in user mode
@@ -265,7 +266,7 @@ static void proc0_main(void) {
      * Create init process using newproc
      */
     extern int exec(void);
-    int np = newproc();
+    int np = newproc(0);
     if (np == 1) {
         /* Child (P1) resumes here - we're in kernel mode */
         /* CRITICAL: After fork, the global 'u' points to parent's u-area in kernel memory!
@@ -339,11 +340,8 @@ static void proc0_main(void) {
 
     kprintf("Entering scheduler...\n");
     
-    /* Enter scheduler loop (as Process 0) */
-    /* Call swtch() directly - let P1 run */
-    for (;;) {
-        swtch();
-    }
+    /* Process 0 becomes the swapper; it sleeps until someone must come in */
+    sched();
     
     /* Should never return */
     panic("scheduler returned");
@@ -386,9 +384,10 @@ void kmain(uint32_t magic, multiboot_info_t *mbi) {
     /* Initialize core allocator map */
     /* coremap manages memory from _end to maxmem */
     /* Calculate start in 64-byte clicks */
-    /* _end is a byte address. We need to align up to 64 bytes */
-    uint32_t mem_start_byte = (uint32_t)_end;
-    uint32_t mem_start = (mem_start_byte + 63) / 64;
+    /* _end is a byte address. Align up to a page so that core,
+     * which is handed out a page at a time, stays page-aligned */
+    uint32_t mem_start_byte = pground((uint32_t)_end);
+    uint32_t mem_start = mem_start_byte / 64;
     
     /* maxmem is already in 64-byte clicks */
     if (mem_start >= maxmem) {
@@ -397,15 +396,15 @@ void kmain(uint32_t magic, multiboot_info_t *mbi) {
     
     int free_mem = maxmem - mem_start;
     
-    /* Initialize empty map */
-    /* Since coremap is bss (zeroed), it is already an empty map */
-    
-    /* Free the available memory into the map */
-    mfree(coremap, free_mem, mem_start);
+    /* Free the available memory into the core allocator */
+    coreinit(mem_start, free_mem);
     
     kprintf("Memory map initialized: start=%x size=%d clicks (%d KB)\n", 
            mem_start, free_mem, (free_mem * 64) / 1024);
     
+    /* Map the kernel and turn on paging */
+    vminit();
+    
     /* Initialize clock */
     setup_clock();
     
@@ -435,6 +434,7 @@ void kmain(uint32_t magic, multiboot_info_t *mbi) {
     static struct user proc0_u __attribute__((aligned(64)));
     proc[0].p_addr = ((uint32_t)&proc0_u) / 64;
     proc[0].p_size = USIZE;
+    proc[0].p_cr3 = (uint32_t)kpgdir;
     proc[0].p_pid = 0;
     proc[0].p_ppid = 0;
     proc[0].p_umask = 0;
@@ -462,6 +462,22 @@ void kmain(uint32_t magic, multiboot_info_t *mbi) {
     rd_init();
     ide_init();
 
+    /*
+     * Swap on blocks SWPLO..SWPLO+NSWAP-1 of the IDE disk; a
+     * file system on it must end before SWPLO (see smount).
+     */
+    extern daddr_t ide_nblock;
+    if (ide_nblock >= SWPLO + NSWAP) {
+        swapdev = makedev(1, 0);
+        swplo = SWPLO;
+        nswap = NSWAP;
+        mfree(swapmap, nswap, swplo);
+        kprintf("swap: %d blocks at %d on ide0\n", nswap, swplo);
+    } else if (ide_nblock > 0) {
+        kprintf("swap: ide0 has %d blocks, needs %d; no swap\n",
+                ide_nblock, SWPLO + NSWAP);
+    }
+
     /* Initialize buffer cache */
     binit();
     
@@ -576,11 +592,9 @@ int estabur(int nt, int nd, int ns, int sep) {
     }
     
     /* 
-     * In a flat memory model (all segments 0-4GB), we don't need to change 
-     * segmentation registers here. 
-     * Real protection would require updating GDT/LDT or CR3 (Paging).
-     * For now, we assume a cooperative or single-user-like environment 
-     * or rely on the fact effectively we are valid.
+     * The user segments are fixed; protection comes from each
+     * process's page directory, which maps only its own image
+     * (see expand()).  Nothing to load here.
      */
      
     return 0;
@@ -1,6 +1,6 @@
 /* malloc.c - Unix V6 x86 Port Memory Allocation
  * Ported from original V6 ken/malloc.c for PDP-11
- * Manages core map and swap map allocation
+ * Manages core and swap map allocation
  *
  * Original authors: Ken Thompson, Dennis Ritchie
  * x86 port: Unix V6 Modernization Project
@@ -9,12 +9,161 @@
 #include "include/types.h"
 #include "include/param.h"
 #include "include/systm.h"
+#include "include/vm.h"
 
 struct map {
     int m_size;
     int m_addr;
 };
 
+/*
+ * Core is not kept in a map but by a binary buddy allocator,
+ * in pages; coremap only names it to malloc and mfree.  A
+ * free block of 2^k pages is on bdfree[k], linked through its
+ * first page.  bdord[pfn] is k+1 if page pfn heads a free
+ * block of order k, else 0.  Sizes and addresses passed in
+ * are still in clicks and must be whole pages.
+ */
+#define NBORD       15          /* 2^14 pages cover MAXMEM */
+
+struct bdlink {
+    struct bdlink *l_next;
+    struct bdlink *l_prev;
+};
+
+typedef char nbord_check[(NBORD <= MSNORD) ? 1 : -1];
+
+static struct bdlink *bdfree[NBORD];
+static uint8_t bdord[MAXMEM / PGCLICK];
+
+struct memstat corestat;
+
+static void bdpush(uint32_t pfn, int k) {
+    struct bdlink *l = (struct bdlink *)(pfn << PGSHIFT);
+
+    l->l_prev = NULL;
+    l->l_next = bdfree[k];
+    if (l->l_next) {
+        l->l_next->l_prev = l;
+    }
+    bdfree[k] = l;
+    bdord[pfn] = k + 1;
+    corestat.ms_free += 1 << k;
+    corestat.ms_nblk[k]++;
+}
+
+static void bdunlink(uint32_t pfn, int k) {
+    struct bdlink *l = (struct bdlink *)(pfn << PGSHIFT);
+
+    if (l->l_prev) {
+        l->l_prev->l_next = l->l_next;
+    } else {
+        bdfree[k] = l->l_next;
+    }
+    if (l->l_next) {
+        l->l_next->l_prev = l->l_prev;
+    }
+    bdord[pfn] = 0;
+    corestat.ms_free -= 1 << k;
+    corestat.ms_nblk[k]--;
+}
+
+/*
+ * bdrelease - Free n pages from pfn, merging each block
+ * with its buddy for as long as the buddy is free too
+ */
+static void bdrelease(uint32_t pfn, uint32_t n) {
+    uint32_t b;
+    int k, j;
+
+    while (n) {
+        for (k = 0; k < NBORD - 1 && (pfn & (1 << k)) == 0 &&
+             (2u << k) <= n; k++);
+        n -= 1 << k;
+        b = pfn + (1 << k);
+        for (j = k; j < NBORD - 1 && bdord[pfn ^ (1 << j)] == j + 1; j++) {
+            bdunlink(pfn ^ (1 << j), j);
+            pfn &= ~(1 << j);
+        }
+        bdpush(pfn, j);
+        pfn = b;
+    }
+}
+
+/*
+ * bdalloc - Take np pages, splitting the smallest block big
+ * enough and giving back what lies past np
+ * Returns the first page, 0 if there is no such block.
+ */
+static uint32_t bdalloc(uint32_t np) {
+    uint32_t pfn;
+    int k, j;
+
+    for (k = 0; (1u << k) < np; k++);
+    for (j = k; j < NBORD && bdfree[j] == NULL; j++);
+    if (j >= NBORD) {
+        corestat.ms_nfail++;
+        return 0;
+    }
+    pfn = (uint32_t)bdfree[j] >> PGSHIFT;
+    bdunlink(pfn, j);
+    while (j > k) {
+        j--;
+        bdpush(pfn + (1 << j), j);
+    }
+    if (np < (1u << k)) {
+        bdrelease(pfn + np, (1 << k) - np);
+    }
+    corestat.ms_nalloc++;
+    return pfn;
+}
+
+/*
+ * bdfind - Order of the free block holding page pfn, -1 if
+ * the page is in use
+ */
+static int bdfind(uint32_t pfn) {
+    int k;
+
+    for (k = 0; k < NBORD; k++) {
+        if (bdord[pfn & ~((1 << k) - 1)] == k + 1) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/*
+ * bdtake - Take the free page pfn, splitting the block that
+ * holds it and freeing the halves around it
+ */
+static void bdtake(uint32_t pfn) {
+    uint32_t b;
+    int k;
+
+    k = bdfind(pfn);
+    b = pfn & ~((1 << k) - 1);
+    bdunlink(b, k);
+    while (k > 0) {
+        k--;
+        if (pfn >= b + (1 << k)) {
+            bdpush(b, k);
+            b += 1 << k;
+        } else {
+            bdpush(b + (1 << k), k);
+        }
+    }
+}
+
+/*
+ * coreinit - Give the size clicks of core at addr to the
+ * allocator; a partial page at the end is not used
+ */
+void coreinit(uint32_t addr, int size) {
+    corestat.ms_total = size / PGCLICK;
+    bdrelease(addr / PGCLICK, size / PGCLICK);
+}
+
 /*
  * malloc - Allocate space in map
  *
@@ -29,6 +178,10 @@ uint32_t malloc(uint32_t *pmap, int size) {
     register int a;
     register struct map *bp;
 
+    if (pmap == coremap) {
+        return(bdalloc((size + PGCLICK - 1) / PGCLICK) * PGCLICK);
+    }
+
     for (bp = mp; bp->m_size; bp++) {
         if (bp->m_size >= size) {
             a = bp->m_addr;
@@ -57,6 +210,11 @@ void mfree(uint32_t *pmap, int size, uint32_t addr) {
     register struct map *bp;
     register int t;
 
+    if (pmap == coremap) {
+        bdrelease(addr / PGCLICK, (size + PGCLICK - 1) / PGCLICK);
+        return;
+    }
+
     bp = mp;
     for (; (uint32_t)bp->m_addr <= addr && bp->m_size != 0; bp++);
     
@@ -86,3 +244,48 @@ void mfree(uint32_t *pmap, int size, uint32_t addr) {
         }
     }
 }
+
+/*
+ * mgrow - Extend in place an allocation that ends at addr
+ *
+ * Takes size units starting at addr if they are free, so
+ * the caller's extent grows without moving.
+ * Returns 1 if so, 0 if addr is in use or the free extent
+ * there is too short.
+ */
+int mgrow(uint32_t *pmap, uint32_t addr, int size) {
+    struct map *mp = (struct map *)pmap;
+    register struct map *bp;
+    uint32_t pfn, np;
+
+    if (pmap == coremap) {
+        pfn = addr / PGCLICK;
+        np = (size + PGCLICK - 1) / PGCLICK;
+        if (pfn + np > MAXMEM / PGCLICK) {
+            return(0);
+        }
+        for (addr = pfn; addr < pfn + np; addr++) {
+            if (bdfind(addr) < 0) {
+                return(0);
+            }
+        }
+        for (addr = pfn; addr < pfn + np; addr++) {
+            bdtake(addr);
+        }
+        corestat.ms_nalloc++;
+        return(1);
+    }
+
+    for (bp = mp; bp->m_size && (uint32_t)bp->m_addr < addr; bp++);
+    if (bp->m_size < size || (uint32_t)bp->m_addr != addr) {
+        return(0);
+    }
+    bp->m_addr += size;
+    if ((bp->m_size -= size) == 0) {
+        do {
+            bp++;
+            (bp-1)->m_addr = bp->m_addr;
+        } while (((bp-1)->m_size = bp->m_size));
+    }
+    return(1);
+}
@@ -25,16 +25,27 @@ extern struct inode *ialloc(dev_t dev);
 extern struct file *falloc(void);
 extern void readi(struct inode *ip);
 extern void writei(struct inode *ip);
+extern int iovnext(void);
+extern int copyi(struct inode *sip, off_t soff, struct inode *dip, off_t doff, int count);
 
 /*
- * readp - Read from a pipe
- * Called from read()
+ * min - Return the minimum of two values
  */
-void readp(struct file *fp) {
+static int min(int a, int b) {
+    if (a < b) {
+        return a;
+    }
+    return b;
+}
+
+/*
+ * prwait - Wait for data in a pipe being read
+ * Returns the bytes ready with the pipe locked, or 0 with
+ * it unlocked when there is no writer or the read would block.
+ */
+static int prwait(struct file *rp) {
     register struct inode *ip;
-    register struct file *rp;
 
-    rp = fp;
     ip = rp->f_inode;
 
 loop:
@@ -61,79 +72,219 @@ loop:
          */
         prele(ip);
         if (ip->i_count < 2)
-            return;
-        if (fp->f_flag & FNONBLOCK) {
+            return 0;
+        if (rp->f_flag & FNONBLOCK) {
             u.u_error = EAGAIN;
-            return;
+            return 0;
         }
         ip->i_mode |= IREAD;
         sleep(ip+2, PPIPE);
         goto loop;
     }
-
-    u.u_offset[0] = 0;
-    u.u_offset[1] = rp->f_offset[1];
-    readi(ip);
-    rp->f_offset[1] = u.u_offset[1];
-    prele(ip);
+    return ip->i_size1 - rp->f_offset[1];
 }
 
 /*
- * writep - Write to a pipe
- * Called from write()
+ * pwwait - Wait for room in a pipe being written
+ * Returns the room left with the pipe locked, or 0 with
+ * it unlocked and u_error set.
  */
-void writep(struct file *fp) {
+static int pwwait(struct file *wp) {
     register struct inode *ip;
-    register struct file *rp;
-    int c;
-    
-    rp = fp;
-    ip = rp->f_inode;
-    c = u.u_count;
-    
+
+    ip = wp->f_inode;
+
 loop:
     plock(ip);
     
-    if (c == 0) {
-        prele(ip);
-        u.u_count = 0;
-        return;
-    }
-    
     if (ip->i_count < 2) {
         prele(ip);
         u.u_error = EPIPE;
         psignal(u.u_procp, SIGPIPE);
-        return;
+        return 0;
     }
     
     if (ip->i_size1 == PIPSIZ) {
-        if (fp->f_flag & FNONBLOCK) {
+        if (wp->f_flag & FNONBLOCK) {
             prele(ip);
             u.u_error = EAGAIN;
-            return;
+            return 0;
         }
         ip->i_mode |= IWRITE;
         prele(ip);
         sleep(ip+1, PPIPE);
         goto loop;
     }
-    
-    u.u_offset[0] = 0;
-    u.u_offset[1] = ip->i_size1;
-    u.u_count = c;
-    if (u.u_count > PIPSIZ - u.u_offset[1])
-        u.u_count = PIPSIZ - u.u_offset[1];
-        
-    c -= u.u_count;
-    writei(ip);
+    return PIPSIZ - ip->i_size1;
+}
+
+/*
+ * pwdone - Unlock a pipe after writing and wake its reader
+ */
+static void pwdone(struct inode *ip) {
     prele(ip);
-    
     if (ip->i_mode&IREAD) {
         ip->i_mode &= ~IREAD;
         wakeup(ip+2);
     }
-    goto loop;
+}
+
+/*
+ * readp - Read from a pipe
+ * Called from read()
+ */
+void readp(struct file *fp) {
+    register struct inode *ip;
+    register struct file *rp;
+
+    rp = fp;
+    ip = rp->f_inode;
+
+    if (prwait(rp) == 0)
+        return;
+    u.u_offset[0] = 0;
+    u.u_offset[1] = rp->f_offset[1];
+    readi(ip);
+    rp->f_offset[1] = u.u_offset[1];
+    prele(ip);
+}
+
+/*
+ * writep - Write to a pipe
+ * Called from write()
+ *
+ * Each writei is bounded by the room in the pipe, so the
+ * segments of a writev are stepped through here, with the
+ * pipe kept locked from one to the next while there is room.
+ */
+void writep(struct file *fp) {
+    register struct inode *ip;
+    int c, n, nseg;
+    
+    ip = fp->f_inode;
+    c = u.u_count;
+    n = 0;
+    
+    for (;;) {
+        if (c == 0) {
+            if (!iovnext())
+                break;
+            c = u.u_count;
+        }
+        if (n == 0) {
+            n = pwwait(fp);
+            if (n == 0) {
+                u.u_count = c;
+                return;
+            }
+        }
+        u.u_offset[0] = 0;
+        u.u_offset[1] = ip->i_size1;
+        u.u_count = min(c, n);
+        c -= u.u_count;
+        n -= u.u_count;
+        nseg = u.u_iovcnt;
+        u.u_iovcnt = 0;
+        writei(ip);
+        u.u_iovcnt = nseg;
+        c += u.u_count;
+        if (n == 0 || u.u_error) {
+            pwdone(ip);
+            n = 0;
+            if (u.u_error)
+                break;
+        }
+    }
+    if (n != 0)
+        pwdone(ip);
+    u.u_count = c;
+}
+
+/*
+ * pipein - Move bytes of a file into a pipe
+ * Used by splice and sendfile.  The data goes from the
+ * file's cache buffers straight into the pipe's without
+ * passing through user space.  Returns the bytes moved.
+ */
+int pipein(struct file *wp, struct inode *sip, off_t off, int count) {
+    register struct inode *ip;
+    int n, done;
+    
+    ip = wp->f_inode;
+    done = 0;
+    while (count > 0) {
+        n = pwwait(wp);
+        if (n == 0)
+            break;
+        n = copyi(sip, off, ip, ip->i_size1, min(n, count));
+        pwdone(ip);
+        if (n == 0)
+            break;
+        off += n;
+        done += n;
+        count -= n;
+    }
+    return done;
+}
+
+/*
+ * pipeout - Move bytes out of a pipe into a file or device
+ * Like readp, returns whatever is in the pipe up to count,
+ * waiting only while it is empty.
+ */
+int pipeout(struct file *rp, struct inode *dip, off_t off, int count) {
+    register struct inode *ip;
+    int n;
+    
+    ip = rp->f_inode;
+    n = prwait(rp);
+    if (n == 0)
+        return 0;
+    if ((dip->i_mode & IFMT) == IFREG)
+        plock(dip);
+    n = copyi(ip, rp->f_offset[1], dip, off, min(n, count));
+    if ((dip->i_mode & IFMT) == IFREG)
+        prele(dip);
+    rp->f_offset[1] += n;
+    prele(ip);
+    return n;
+}
+
+/*
+ * pipecopy - Move bytes from one pipe to another
+ * Used by splice, and by tee with consume clear, which
+ * leaves the data in the first pipe for its reader.  The
+ * second pipe is only taken if it is free and has room, so
+ * we never sleep holding the first.
+ */
+int pipecopy(struct file *rp, struct file *wp, int count, int consume) {
+    register struct inode *ip, *op;
+    int n;
+    
+    ip = rp->f_inode;
+    op = wp->f_inode;
+    for (;;) {
+        n = prwait(rp);
+        if (n == 0)
+            return 0;
+        if ((op->i_flag & ILOCK) == 0 && op->i_count >= 2 &&
+            op->i_size1 < PIPSIZ) {
+            op->i_flag |= ILOCK;
+            break;
+        }
+        prele(ip);
+        if (pwwait(wp) == 0)
+            return 0;
+        prele(op);
+    }
+    
+    n = min(min(n, count), PIPSIZ - op->i_size1);
+    n = copyi(ip, rp->f_offset[1], op, op->i_size1, n);
+    if (consume)
+        rp->f_offset[1] += n;
+    prele(ip);
+    pwdone(op);
+    return n;
 }
 
 /*
@@ -16,6 +16,7 @@
 #include "include/buf.h"
 #include "include/file.h"
 #include "include/inode.h"
+#include "include/vm.h"
 
 /* External declarations */
 extern struct proc proc[];
@@ -31,8 +32,7 @@ extern int spl0(void);
 extern int spl6(void);
 
 /* Memory segment operations from x86.S */
-extern void copyseg(uint32_t from, uint32_t to);
-extern void clearseg(uint32_t seg);
+extern void clearsegs(uint32_t seg, int n);
 extern int savu_switch(uint32_t *rsav, void *old_dest, void *new_src, uint32_t count);
 extern int spl6(void);
 extern void splx(int);
@@ -43,46 +43,14 @@ extern int savu(uint32_t *);
 extern void retu(uint32_t *);
 extern void aretu(uint32_t *);
 
-/* GDT from x86.S */
-extern uint64_t gdt[];
-
-/* Update GDT user segments for process base address */
+/*
+ * update_pos - Switch to a process's address space
+ *
+ * The user segments start at USERBASE for every process;
+ * what they reach is decided by the page directory in p_cr3.
+ */
 void update_pos(struct proc *p) {
-    /* Offset by USIZE (u-area) so virtual 0 starts after it.
-     * This uses x86 segmentation to provide process isolation.
-     * Virtual address 0 maps to physical (p->p_addr + USIZE) * 64.
-     */
-    uint32_t base = (p->p_addr + USIZE) * 64;
-    uint32_t limit = 0xFFFFF; /* 4GB limit in 4KB units */
-    
-    /* GDT Entry Format:
-     * High: B[31:24] G D 0 Avl Lim[19:16] P DPL S Type B[23:16]
-     * Low:  B[15:0] Lim[15:0]
-     */
-     
-    /* Construct descriptors */
-    /* Code: Type=0xA (Exe/Read), S=1, DPL=3, P=1, D=1, G=1 */
-    uint32_t low = (limit & 0xFFFF) | ((base & 0xFFFF) << 16);
-    uint32_t high = (base & 0xFF000000) |       /* Base[31:24] */
-                    (0xC << 20) |               /* G=1, D=1 */
-                    (limit & 0xF0000) |
-                    (0xFA00) |                  /* P=1, DPL=3, S=1, Type=A */
-                    ((base >> 16) & 0xFF);      /* Base[23:16] */
-            
-
-
-    /* Update GDT[3] (User Code) */
-    gdt[3] = ((uint64_t)high << 32) | low;
-    
-    /* Data: Type=0x2 (Read/Write), S=1, DPL=3, P=1, B=1, G=1 */
-    high = (base & 0xFF000000) | 
-           (0xC << 20) |
-           (limit & 0xF0000) |
-           (0xF200) |                   /* P=1, DPL=3, S=1, Type=2 */
-           ((base >> 16) & 0xFF);
-           
-    /* Update GDT[4] (User Data) */
-    gdt[4] = ((uint64_t)high << 32) | low;
+    lcr3(p->p_cr3);
 
     /* Kernel stack is the global u.u_stack, not the swapped image */
     tss.esp0 = (uint32_t)u.u_stack + sizeof(u.u_stack);
@@ -332,14 +300,14 @@ loop:
  *  - Swap them in
  *  - Repeat
  *
- * For x86 without swapping, this is simplified.
+ * Images are paged, so "room" is simply enough free pages;
+ * vmswapin and vmswapout do the transfers.
  */
 void sched(void) {
     struct proc *p1;
     struct proc *rp;
     int n;
-    int a;
-    
+
     /*
      * Find user to swap in
      * Of users ready, select one out longest
@@ -353,32 +321,73 @@ sloop:
 loop:
     spl6();
     n = -1;
-    
+    p1 = NULL;
+
     for (rp = &proc[0]; rp < &proc[NPROC]; rp++) {
-        if (rp->p_stat == SRUN && 
+        if (rp->p_stat == SRUN &&
             (rp->p_flag & SLOAD) == 0 &&
             rp->p_time > n) {
             p1 = rp;
             n = rp->p_time;
         }
     }
-    
+
     if (n == -1) {
         /* No process waiting to be swapped in */
         runout++;
         sleep(&runout, PSWP);
         goto loop;
     }
-    
+
     /*
      * See if there is core for that process
-     * For x86 without paging/swapping, just set SLOAD
      */
     spl0();
+    if (vmswapin(p1)) {
+        goto loop;
+    }
+
+    /*
+     * None found,
+     * look around for easy core
+     */
+    spl6();
+    for (rp = &proc[0]; rp < &proc[NPROC]; rp++) {
+        if ((rp->p_stat == SWAIT || rp->p_stat == SSTOP) && vmswapok(rp)) {
+            goto found2;
+        }
+    }
+
+    /*
+     * No easy core,
+     * if this process is deserving,
+     * look around for
+     * oldest process in core
+     */
+    if (n < 3) {
+        goto sloop;
+    }
+    n = -1;
+    for (rp = &proc[0]; rp < &proc[NPROC]; rp++) {
+        if ((rp->p_stat == SRUN || rp->p_stat == SSLEEP) && vmswapok(rp) &&
+            rp->p_time > n) {
+            p1 = rp;
+            n = rp->p_time;
+        }
+    }
+    if (n < 2) {
+        goto sloop;
+    }
     rp = p1;
-    rp->p_flag |= SLOAD;
-    rp->p_time = 0;
-    
+
+    /*
+     * Swap user out
+     */
+found2:
+    spl0();
+    if (!vmswapout(rp)) {
+        goto sloop;
+    }
     goto loop;
 }
 
@@ -386,73 +395,54 @@ loop:
  * expand - Expand (or contract) process to new size
  * From original V6 ken/slp.c
  *
- * For x86 without proper memory management, this is a stub.
+ * The image is paged, so it changes size in place: pages
+ * are mapped or unmapped at the end and nothing is copied.
+ * Space past the old size that was already mapped is
+ * cleared, as V6 cleared the grown part of the image.
  */
 void expand(int newsize) {
     struct proc *p;
-    int a1, a2;
-    int i, n;
+    uint32_t o, n, a;
     
     p = u.u_procp;
+    o = (p->p_size - USIZE) * 64;
+    n = (newsize - USIZE) * 64;
     
-    /* If shrinking, this is easy, but we only support growing or same */
-    if (newsize <= p->p_size) {
-        /* Should release memory, but simplified */
+    if (n < o) {
+        vmunmap(p->p_cr3, pground(n), pground(o));
         p->p_size = newsize;
         return;
     }
     
-    /* Allocate new area */
-    a1 = malloc(coremap, newsize);
-    if (a1 == 0) {
-        /* No space */
+    if (vmmap(p->p_cr3, pground(o), n)) {
+        vmunmap(p->p_cr3, pground(o), n);
         kprintf("expand: out of memory (req %d)\n", newsize);
-        /* Simple wait? No, V6 swaps. Here we panic or error. */
         u.u_error = ENOMEM;
         return;
     }
-    
-    /* Copy current content */
-    a2 = p->p_addr;
-    n = p->p_size;
-    /* Copy in 64-byte chunks */
-    for (i = 0; i < n; i++) {
-        copyseg(a2++, a1++);
+    if (o < pground(o) && vmcow(p->p_cr3, o) == 0) {
+        a = n < pground(o) ? n : pground(o);
+        clearsegs(vtop(p->p_cr3, o) / 64, (a - o) / 64);
     }
-    /* Clear remainder */
-    for (; i < newsize; i++) {
-        clearseg(a1++);
-    }
-    
-    /* Free old memory */
-    mfree(coremap, p->p_size, p->p_addr);
-    
-    /* Update process */
-    p->p_addr = a1 - newsize; /* a1 was incremented */
     p->p_size = newsize;
-    
-    /* Since we moved the u-area (it's part of the image), 
-     * and 'u' is the active copy, we don't need to reload 'u'.
-     * But we updated the backing store location.
-     * When we switch out, 'u' will be saved to the NEW p_addr.
-     */
-    
-    /* Update segments since base changed */
-    update_pos(p);
 }
 
 /*
  * newproc - Create a new process
  * From original V6 ken/slp.c
  *
+ * With isvfork set the child runs in the parent's page
+ * directory instead of a copy of it, until vfdone gives
+ * it one of its own.
+ *
  * Returns 0 in parent, 1 in child
  */
-int newproc(void) {
+int newproc(int isvfork) {
     struct proc *p1, *p2;
     int i;
     int pid;
     int a1;
-    int n, a2;
+    uint32_t pd;
     struct user *child_u;
     
     /* Find empty slot in process table */
@@ -476,7 +466,7 @@ int newproc(void) {
     p1 = u.u_procp;
     
     p2->p_stat = SRUN;
-    p2->p_flag = SLOAD;
+    p2->p_flag = isvfork ? SLOAD | SVFORK : SLOAD;
     p2->p_pri = PUSER;
     p2->p_pid = pid;
     p2->p_ppid = p1->p_pid;
@@ -486,20 +476,37 @@ int newproc(void) {
     p2->p_nice = p1->p_nice;
     p2->p_ttyp = p1->p_ttyp;
     p2->p_textp = p1->p_textp;
+    p2->p_xerr = 0;
     
-    /* Allocate memory for child - MUST do this before savu */
-    a1 = malloc(coremap, p1->p_size);
+    /*
+     * Allocate memory for child - MUST do this before savu.
+     * The u-area is one page of core; the rest of the image
+     * is shared copy-on-write through a new page directory,
+     * so only the page tables are copied.  A vfork child
+     * borrows the parent's directory and copies nothing.
+     */
+    a1 = malloc(coremap, USIZE);
+    if (a1 == 0 && vmreclaim()) {
+        a1 = malloc(coremap, USIZE);
+    }
     if (a1 == 0) {
         u.u_error = ENOMEM;
         p2->p_stat = SNULL;
         return -1;
     }
+    pd = isvfork ? p1->p_cr3 : vmdup(p1->p_cr3);
+    if (pd == 0) {
+        mfree(coremap, USIZE, a1);
+        u.u_error = ENOMEM;
+        p2->p_stat = SNULL;
+        return -1;
+    }
     p2->p_addr = a1;
     p2->p_size = p1->p_size;
+    p2->p_brk = p1->p_brk;
+    p2->p_cr3 = pd;
 
-    /* Calculate these NOW, before savu, to avoid stack changes */
-    n = p1->p_size;
-    a2 = p1->p_addr;
+    /* Calculate this NOW, before savu, to avoid stack changes */
     child_u = (struct user *)(p2->p_addr * 64);
     
     /*
@@ -520,15 +527,10 @@ int newproc(void) {
     /* Parent continues here - u-area already copied atomically */
     /* Fix child's back-pointer to its proc; u.u_procp was copied from parent. */
     child_u->u_procp = p2;
-    
-    /* Copy parent's data/stack segments beyond u-area */
-    for (i = USIZE; i < n; i++) {
-        copyseg(a2 + i, p2->p_addr + i);
-    }
 
     /*
-     * Increase reference counts on shared objects (files and current directory).
-     * The child shares these with the parent.
+     * Increase reference counts on shared objects (files, current directory
+     * and text).  The child shares these with the parent.
      */
     for (i = 0; i < NOFILE; i++) {
         if (u.u_ofile[i] != NULL) {
@@ -538,8 +540,47 @@ int newproc(void) {
     if (u.u_cdir) {
         u.u_cdir->i_count++;
     }
+    if (p2->p_textp) {
+        p2->p_textp->x_count++;
+    }
     
     return 0;
 }
 
 /* issig and psignal are implemented in sig.c */
+
+/*
+ * vfdone - Give a vfork child the page directory pd in
+ * place of its parent's and let the parent run again.
+ * Called at exec and exit.
+ */
+void vfdone(uint32_t pd) {
+    struct proc *p;
+
+    p = u.u_procp;
+    p->p_cr3 = pd;
+    p->p_size = USIZE;
+    p->p_brk = 0;
+    p->p_flag &= ~SVFORK;
+    update_pos(p);
+    wakeup(p);
+}
+
+/*
+ * vfwait - Sleep until the vfork child pid has let go of
+ * our image.  The sleep cannot be interrupted; the child
+ * is running on our stack.
+ */
+struct proc *vfwait(int pid) {
+    struct proc *p;
+
+    for (p = &proc[0]; p < &proc[NPROC]; p++) {
+        if (p->p_pid == pid && p->p_stat != SNULL) {
+            while (p->p_flag & SVFORK) {
+                sleep(p, PSWP);
+            }
+            return p;
+        }
+    }
+    return NULL;
+}
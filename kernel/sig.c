@@ -13,6 +13,7 @@
 #include "include/systm.h"
 #include "include/reg.h"
 #include "include/inode.h"
+#include "include/vm.h"
 
 /* External declarations */
 extern struct proc proc[];
@@ -21,7 +22,6 @@ extern void wakeup(void *chan);
 extern void setrun(struct proc *p);
 extern void swtch(void);
 extern void exit(void);
-extern int grow(uint32_t sp);
 extern int suword(caddr_t addr, int val);
 extern struct inode *namei(int (*func)(void), int flag);
 extern struct inode *maknode(mode_t mode);
@@ -368,11 +368,30 @@ int procxmt(void) {
 /*
  * grow - Grow the stack to accommodate address sp
  *
- * Returns 1 on success, 0 on failure.
+ * The stack ends at USERSIZE; pages are mapped below it down
+ * to the one holding sp, which may not reach the image below.
+ * Returns 1 if the stack grew, 0 if sp is already inside it
+ * or cannot be reached.
  */
 int grow(uint32_t sp) {
-    /* Simplified for now - assumes stack can always grow */
-    (void)sp;
+    struct proc *p;
+    uint32_t base, si;
+
+    p = u.u_procp;
+    base = USERSIZE - u.u_ssize * 64;
+    if (sp >= base) {
+        return 0;
+    }
+    sp &= PG_FRAME;
+    si = (USERSIZE - sp) / 64;
+    if (si > STKMAX || sp < (p->p_size - USIZE) * 64) {
+        return 0;
+    }
+    if (vmmap(p->p_cr3, sp, base)) {
+        vmunmap(p->p_cr3, sp, base);
+        return 0;
+    }
+    u.u_ssize = si;
     return 1;
 }
 
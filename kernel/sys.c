@@ -18,6 +18,8 @@
 #include "include/conf.h"
 #include "include/filsys.h"
 #include "include/text.h"
+#include "include/journal.h"
+#include "include/vm.h"
 
 #define FD_CLOEXEC  0x1
 #define F_DUPFD     0
@@ -41,17 +43,22 @@
 #define PROT_EXEC   0x4
 
 /* Forward declarations */
-void rdwr(int mode);
+void rdwr(int mode, int vec, int pos);
 void open1(struct inode *ip, int mode, int trf);
 void stat1(struct inode *ip);
 void exit(void);
 int copyin(caddr_t src, caddr_t dst, int count);
 int copyout(caddr_t src, caddr_t dst, int count);
+int sys_dup2(void);
+int exec(void);
+int sys_brk(void);
 extern struct user u;
 extern struct proc proc[];
 extern struct file file[];
 extern time_t time[];
 extern int mpid;
+
+int cwdgen;     /* Bumped when a directory is renamed or removed */
 extern int execnt;
 extern void kprintf(const char *fmt, ...);
 extern struct inode *namei(int (*func)(void), int flag);
@@ -69,6 +76,7 @@ extern struct file *falloc(void);
 extern void readi(struct inode *ip);
 extern int estabur(int nt, int nd, int ns, int sep);
 extern void writei(struct inode *ip);
+extern int copyi(struct inode *sip, off_t soff, struct inode *dip, off_t doff, int count);
 extern void wakeup(void *chan);
 extern void sleep(void *chan, int pri);
 extern void swtch(void);
@@ -78,6 +86,9 @@ extern int uchar(void);
 extern int syspipe(void);
 extern void readp(struct file *fp);
 extern void writep(struct file *fp);
+extern int pipein(struct file *wp, struct inode *sip, off_t off, int count);
+extern int pipeout(struct file *rp, struct inode *dip, off_t off, int count);
+extern int pipecopy(struct file *rp, struct file *wp, int count, int consume);
 extern int fubyte(caddr_t addr);
 extern int fuword(caddr_t addr);
 extern int subyte(caddr_t addr, int val);
@@ -97,6 +108,8 @@ extern void bfree(dev_t dev, daddr_t bno);
 extern void ifree(dev_t dev, ino_t ino);
 extern void bcopy(const void *src, void *dst, int count);
 extern void update(void);
+extern void iupdat(struct inode *p, time_t *tm);
+extern void plock(struct inode *ip);
 extern int copyout(caddr_t src, caddr_t dst, int count);
 extern struct buf *bread(dev_t dev, daddr_t blkno);
 extern daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg);
@@ -105,7 +118,7 @@ extern daddr_t bmap(struct inode *ip, daddr_t bn, int rwflg);
  * read - Read system call
  */
 int sysread(void) {
-    rdwr(FREAD);
+    rdwr(FREAD, 0, 0);
     return 0;
 }
 
@@ -113,16 +126,25 @@ int sysread(void) {
  * write - Write system call
  */
 int syswrite(void) {
-    rdwr(FWRITE);
+    rdwr(FWRITE, 0, 0);
     return 0;
 }
 
 /*
  * rdwr - Common code for read and write calls
+ *
+ * The arguments are (fd, buf, count), or (fd, iov, iovcnt)
+ * with vec.  With pos a fourth argument is the offset to use,
+ * and the file offset is left alone.  readi and writei walk
+ * a vector themselves, so it costs one pass however many
+ * segments it has.
  */
-void rdwr(int mode) {
+void rdwr(int mode, int vec, int pos) {
     struct file *fp;
-    int fd;
+    struct inode *ip;
+    struct iovec iov[NIOV];
+    uint32_t total, resid;
+    int fd, i, dev;
     
     fd = u.u_arg[0];
     fp = getf(fd);
@@ -134,10 +156,41 @@ void rdwr(int mode) {
         u.u_error = EBADF;
         return;
     }
+    if (pos && (fp->f_flag & FPIPE)) {
+        u.u_error = ESPIPE;
+        return;
+    }
+    if (pos && (off_t)u.u_arg[3] < 0) {
+        u.u_error = EINVAL;
+        return;
+    }
     
-    u.u_base = (caddr_t)u.u_arg[1];
-    u.u_count = u.u_arg[2];
     u.u_segflg = 0;
+    if (vec) {
+        if (u.u_arg[2] > NIOV) {
+            u.u_error = EINVAL;
+            return;
+        }
+        if (copyin((caddr_t)u.u_arg[1], (caddr_t)iov, u.u_arg[2] * sizeof(iov[0])) < 0) {
+            u.u_error = EFAULT;
+            return;
+        }
+        total = 0;
+        for (i = 0; i < (int)u.u_arg[2]; i++) {
+            total += iov[i].iov_len;
+            if ((int32_t)iov[i].iov_len < 0 || (int32_t)total < 0) {
+                u.u_error = EINVAL;
+                return;
+            }
+        }
+        u.u_base = NULL;
+        u.u_count = 0;
+        u.u_iov = iov;
+        u.u_iovcnt = u.u_arg[2];
+    } else {
+        u.u_base = (caddr_t)u.u_arg[1];
+        u.u_count = total = u.u_arg[2];
+    }
     
     if (fp->f_flag & FPIPE) {
         if (mode == FREAD) {
@@ -146,28 +199,54 @@ void rdwr(int mode) {
             writep(fp);
         }
     } else {
+        ip = fp->f_inode;
         u.u_offset[0] = fp->f_offset[0];
         u.u_offset[1] = fp->f_offset[1];
+        if (pos) {
+            u.u_offset[0] = 0;
+            u.u_offset[1] = u.u_arg[3];
+        }
+        
+        if (mode == FREAD && (ip->i_mode & IFMT) == IFCHR &&
+            (fp->f_flag & FNONBLOCK) && !console_has_input()) {
+            u.u_iovcnt = 0;
+            u.u_error = EAGAIN;
+            return;
+        }
         
+        /*
+         * Files are locked across the transfer, as in V6, so
+         * that no one else allocates their blocks meanwhile
+         * (see dtryalloc).  Devices are not.
+         */
+        dev = (ip->i_mode & IFMT) == IFCHR || (ip->i_mode & IFMT) == IFBLK;
+        if (!dev) {
+            plock(ip);
+        }
         if (mode == FREAD) {
-            if ((fp->f_inode->i_mode & IFMT) == IFCHR &&
-                (fp->f_flag & FNONBLOCK) &&
-                !console_has_input()) {
-                u.u_error = EAGAIN;
-                return;
-            }
-            readi(fp->f_inode);
+            readi(ip);
         } else {
-            if (fp->f_flag & FAPPEND) {
-                uint32_t sz = ((fp->f_inode->i_size0 & 0xFF) << 16) | fp->f_inode->i_size1;
+            if ((fp->f_flag & FAPPEND) && !pos) {
                 u.u_offset[0] = 0;
-                u.u_offset[1] = sz;
+                u.u_offset[1] = ((ip->i_size0 & 0xFF) << 16) | ip->i_size1;
             }
-            writei(fp->f_inode);
+            writei(ip);
         }
-        
-        /* Update file offset */
-        int xfer = u.u_arg[2] - u.u_count;
+        if (!dev) {
+            prele(ip);
+        }
+    }
+    
+    /* What is left is the rest of the segment and those after it */
+    resid = u.u_count;
+    for (i = 0; i < u.u_iovcnt; i++) {
+        resid += u.u_iov[i].iov_len;
+    }
+    u.u_iovcnt = 0;
+    
+    /* Update file offset */
+    if ((fp->f_flag & FPIPE) == 0 && !pos) {
+        int xfer = total - resid;
         fp->f_offset[1] += xfer;
         /* Handle overflow */
         if (fp->f_offset[1] < xfer) {
@@ -176,7 +255,72 @@ void rdwr(int mode) {
     }
     
     /* Return number of bytes transferred */
-    u.u_ar0[EAX] = u.u_arg[2] - u.u_count;
+    u.u_ar0[EAX] = total - resid;
+}
+
+/*
+ * pread, pwrite - Read or write at an offset (syscalls #281, #290)
+ *
+ * pread(fd, buf, count, offset).  The 64-bit forms (#282,
+ * #291) pass the offset as two words; no file reaches 4GB,
+ * so the high word must be 0.
+ */
+int sys_pread(void) {
+    rdwr(FREAD, 0, 1);
+    return 0;
+}
+
+int sys_pwrite(void) {
+    rdwr(FWRITE, 0, 1);
+    return 0;
+}
+
+int sys_pread64(void) {
+    if (u.u_arg[4] != 0) {
+        u.u_error = EFBIG;
+        return -1;
+    }
+    rdwr(FREAD, 0, 1);
+    return 0;
+}
+
+int sys_pwrite64(void) {
+    if (u.u_arg[4] != 0) {
+        u.u_error = EFBIG;
+        return -1;
+    }
+    rdwr(FWRITE, 0, 1);
+    return 0;
+}
+
+/*
+ * readv, writev - Scatter and gather I/O (syscalls #298, #398)
+ *
+ * readv(fd, iov, iovcnt), with at most NIOV segments.
+ */
+int sys_readv(void) {
+    rdwr(FREAD, 1, 0);
+    return 0;
+}
+
+int sys_writev(void) {
+    rdwr(FWRITE, 1, 0);
+    return 0;
+}
+
+/*
+ * preadv, pwritev - Vectored I/O at an offset (syscalls #283, #292)
+ *
+ * preadv(fd, iov, iovcnt, offset).
+ */
+int sys_preadv(void) {
+    rdwr(FREAD, 1, 1);
+    return 0;
+}
+
+int sys_pwritev(void) {
+    rdwr(FWRITE, 1, 1);
+    return 0;
 }
 
 /*
@@ -441,12 +585,7 @@ int unlink(void) {
     prele(ip);
     
     /* Clear directory entry */
-    u.u_offset[1] -= DIRSIZ + 2;
-    u.u_base = (caddr_t)&u.u_dent;
-    u.u_count = DIRSIZ + 2;
-    u.u_dent.u_ino = 0;
-    u.u_segflg = 1;
-    writei(u.u_pdir);
+    dirremove();
     
     iput(u.u_pdir);
     u.u_pdir = NULL;
@@ -458,6 +597,85 @@ int unlink(void) {
     return 0;
 }
 
+/*
+ * cwdset - Work out the path of the directory chdir is
+ * moving to from the old one and the name it was given
+ *
+ * Without symbolic links this is plain string work.  ".."
+ * is only trusted when nothing but the root is mounted,
+ * since at the root of a mounted volume it goes nowhere.
+ * A path that is not known or too long leaves u_cwd empty,
+ * for getcwd to rebuild.
+ */
+static void cwdset(caddr_t name) {
+    char path[CWDLEN];
+    struct mount *mp;
+    int c, len, start;
+    
+    len = 0;
+    c = fubyte(name);
+    if (c != '/') {
+        if (u.u_cwd[0] == '\0' || u.u_cwdgen != cwdgen) {
+            goto unknown;
+        }
+        for (len = 0; u.u_cwd[len] != '\0'; len++) {
+            path[len] = u.u_cwd[len];
+        }
+        if (len == 1) {
+            len = 0;    /* "/" */
+        }
+    }
+    
+    for (;;) {
+        while ((c = fubyte(name)) == '/') {
+            name++;
+        }
+        if (c <= 0) {
+            break;
+        }
+        
+        /* Append the component, then see if it was "." or ".." */
+        start = len;
+        if (len >= CWDLEN - 1) {
+            goto unknown;
+        }
+        path[len++] = '/';
+        while ((c = fubyte(name)) > 0 && c != '/') {
+            if (len >= CWDLEN - 1) {
+                goto unknown;
+            }
+            path[len++] = c;
+            name++;
+        }
+        if (len - start == 2 && path[start + 1] == '.') {
+            len = start;
+        } else if (len - start == 3 && path[start + 1] == '.' &&
+                   path[start + 2] == '.') {
+            for (mp = &mount[1]; mp < &mount[NMOUNT]; mp++) {
+                if (mp->m_bufp != NULL) {
+                    goto unknown;
+                }
+            }
+            len = start;
+            while (len > 0 && path[--len] != '/') {
+            }
+        }
+    }
+    if (c < 0) {
+        goto unknown;
+    }
+    if (len == 0) {
+        path[len++] = '/';
+    }
+    path[len] = '\0';
+    bcopy(path, u.u_cwd, len + 1);
+    u.u_cwdgen = cwdgen;
+    return;
+    
+unknown:
+    u.u_cwd[0] = '\0';
+}
+
 /*
  * chdir - Change directory system call
  */
@@ -484,6 +702,7 @@ int chdir(void) {
     prele(ip);
     iput(u.u_cdir);
     u.u_cdir = ip;
+    cwdset((caddr_t)u.u_arg[0]);
     return 0;
 }
 
@@ -492,16 +711,14 @@ int chdir(void) {
  */
 int getcwd(void) {
     struct inode *ip, *parent;
-    struct buf *bp;
-    ino_t *ino_ptr;
-    char *name_ptr;
+    ino_t c_ino;
     int c, ino;
     caddr_t buf_ptr;
     int size;
     char buf[512];
     int pathlen;
     int found;
-    int offset;
+    off_t offset;
     int namelen;
     dev_t dev;
     
@@ -514,6 +731,22 @@ int getcwd(void) {
         return -1;
     }
     
+    /* The path chdir worked out, unless a directory has moved since */
+    if (u.u_cwd[0] != '\0' && u.u_cwdgen == cwdgen) {
+        for (pathlen = 0; u.u_cwd[pathlen] != '\0'; pathlen++) {
+        }
+        if (pathlen >= size) {
+            u.u_error = EINVAL;
+            return -1;
+        }
+        if (copyout(u.u_cwd, buf_ptr, pathlen + 1) < 0) {
+            u.u_error = EFAULT;
+            return -1;
+        }
+        u.u_ar0[EAX] = (int)buf_ptr;
+        return 0;
+    }
+    
     pathlen = 0;
     
     /* Start from current directory */
@@ -544,58 +777,19 @@ int getcwd(void) {
             return -1;
         }
         
-        /* Look for ".." entry in current inode to get parent inode */
-        /* Search current directory for ".." */
-        found = 0;
-        offset = 0;
-        int pino = 0;
-        
-        while ((uint32_t)offset < ((uint32_t)ip->i_size1 + ((uint32_t)ip->i_size0 << 16)) && !found) {
-            bp = bread(ip->i_dev, bmap(ip, offset >> 9, 0));
-            if (u.u_error) {
-                iput(ip);
-                brelse(bp);
-                return -1;
-            }
-            
-            if (bp == NULL || bp->b_flags & B_ERROR) {
-                iput(ip);
-                if (bp) brelse(bp);
-                u.u_error = EIO;
-                return -1;
-            }
-            
-            /* Scan directory block for ".." */
-            char *blk_addr = bp->b_addr;
-            int blk_offset = 0;
-            
-            while (blk_offset < 512 && (uint32_t)(offset + blk_offset) < 
-                   ((uint32_t)ip->i_size1 + ((uint32_t)ip->i_size0 << 16))) {
-                ino_ptr = (ino_t *)(blk_addr + blk_offset);
-                name_ptr = blk_addr + blk_offset + 2;
-                
-                /* Check for ".." */
-                if (name_ptr[0] == '.' && name_ptr[1] == '.' && 
-                    name_ptr[2] == '\0') {
-                    pino = *ino_ptr;
-                    found = 1;
-                    break;
-                }
-                
-                blk_offset += 2 + DIRSIZ;
-            }
-            
-            brelse(bp);
-            offset += 512;
+        /* Look up ".." in current directory to get parent inode */
+        int pino = dirfind(ip, "..");
+        if (u.u_error) {
+            iput(ip);
+            return -1;
         }
-        
-        if (!found || pino == 0) {
+        if (pino == 0) {
             iput(ip);
             u.u_error = EIO;
             return -1;
         }
         
-        /* Now search parent directory for our inode */
+        /* Now search parent directory for this inode */
         parent = iget(dev, pino);
         if (parent == NULL) {
             iput(ip);
@@ -603,66 +797,27 @@ int getcwd(void) {
             return -1;
         }
         
-        /* Search parent directory for this inode */
         found = 0;
         offset = 0;
-        
-        while ((uint32_t)offset < ((uint32_t)parent->i_size1 + ((uint32_t)parent->i_size0 << 16)) && !found) {
-            bp = bread(parent->i_dev, bmap(parent, offset >> 9, 0));
-            if (u.u_error) {
-                iput(ip);
-                iput(parent);
-                brelse(bp);
-                return -1;
-            }
-            
-            if (bp == NULL || bp->b_flags & B_ERROR) {
-                iput(ip);
-                iput(parent);
-                if (bp) brelse(bp);
-                u.u_error = EIO;
-                return -1;
+        while ((namelen = dirread(parent, &offset, &c_ino, u.u_dbuf, NULL)) > 0) {
+            if (c_ino != ino) {
+                continue;
             }
-            
-            /* Scan directory block for our inode */
-            /* Each entry is: 2 bytes ino + DIRSIZ bytes name */
-            char *blk_addr = bp->b_addr;
-            int blk_offset = 0;
-            
-            while (blk_offset < 512 && (uint32_t)(offset + blk_offset) < 
-                   ((uint32_t)parent->i_size1 + ((uint32_t)parent->i_size0 << 16))) {
-                ino_ptr = (ino_t *)(blk_addr + blk_offset);
-                name_ptr = blk_addr + blk_offset + 2;
-                
-                if (*ino_ptr == ino) {
-                    /* Found it - add name to path */
-                    namelen = 0;
-                    while (namelen < DIRSIZ && name_ptr[namelen] && 
-                           name_ptr[namelen] != '\0') {
-                        namelen++;
-                    }
-                    
-                    if (pathlen + namelen + 1 < 510) {
-                        /* Shift existing path right to make room */
-                        for (c = pathlen; c >= 0; c--) {
-                            buf[c + namelen + 1] = buf[c];
-                        }
-                        /* Add component */
-                        buf[0] = '/';
-                        for (c = 0; c < namelen; c++) {
-                            buf[c + 1] = name_ptr[c];
-                        }
-                        pathlen += namelen + 1;
-                        found = 1;
-                    }
-                    break;
+            /* Found it - add name to path */
+            if (pathlen + namelen + 1 < 510) {
+                /* Shift existing path right to make room */
+                for (c = pathlen; c >= 0; c--) {
+                    buf[c + namelen + 1] = buf[c];
+                }
+                /* Add component */
+                buf[0] = '/';
+                for (c = 0; c < namelen; c++) {
+                    buf[c + 1] = u.u_dbuf[c];
                 }
-                
-                blk_offset += 2 + DIRSIZ;
+                pathlen += namelen + 1;
+                found = 1;
             }
-            
-            brelse(bp);
-            offset += 512;
+            break;
         }
         
         iput(ip);
@@ -692,6 +847,12 @@ int getcwd(void) {
     buf[pathlen] = '\0';
     copyout(buf, buf_ptr, pathlen + 1);
     u.u_ar0[EAX] = (int)buf_ptr;
+    
+    /* Keep it for next time */
+    if (pathlen < CWDLEN) {
+        bcopy(buf, u.u_cwd, pathlen + 1);
+        u.u_cwdgen = cwdgen;
+    }
     return 0;
 }
 
@@ -1054,9 +1215,7 @@ int getswit(void) {
  * sbreak - Set process break (data segment size)
  */
 int sbreak(void) {
-    /* Simplified - just record the new size */
-    u.u_dsize = (u.u_arg[0] + 63) >> 6;
-    return 0;
+    return sys_brk();
 }
 
 /*
@@ -1137,13 +1296,27 @@ int smount(void) {
     brelse(bp);
 
     fp = (struct filsys *)cp->b_addr;
-    if (u.u_arg[2]) {
+
+    /* The swap area must lie past the end of the file system */
+    if (nswap && dev == swapdev && fp->s_fsize > swplo) {
+        brelse(cp);
+        u.u_error = EBUSY;
+        iput(dp);
+        return -1;
+    }
+
+    jinit(dev, fp);
+    fp->s_flock = 0;
+    fp->s_ilock = 0;
+    fp->s_ronly = 0;
+    if (u.u_arg[2] & MNT_RDONLY) {
         fp->s_ronly = 1;
     }
 
     mp->m_bufp = cp;
     mp->m_dev = dev;
     mp->m_inodp = dp;
+    mp->m_flags = u.u_arg[2];
     dp->i_flag |= IMOUNT;
     prele(dp);
     return 0;
@@ -1187,6 +1360,7 @@ int sumount(void) {
     }
 
     /* Refuse if any inode still active on this device */
+    xumount(dev);
     for (struct inode *ip2 = &inode[0]; ip2 < &inode[NINODE]; ip2++) {
         if (ip2->i_dev == dev && ip2->i_count != 0) {
             if (mp->m_inodp != ip2) {
@@ -1196,6 +1370,14 @@ int sumount(void) {
         }
     }
 
+    /* Forget inodes cached from its i-list */
+    for (struct inode *ip2 = &inode[0]; ip2 < &inode[NINODE]; ip2++) {
+        if (ip2->i_dev == dev && ip2->i_count == 0) {
+            ip2->i_number = 0;
+        }
+    }
+
+    jclose(dev);
     mp->m_inodp->i_flag &= ~IMOUNT;
     iput(mp->m_inodp);
     brelse(mp->m_bufp);
@@ -1245,6 +1427,24 @@ int ptrace(void) {
 
 
 
+/*
+ * freeproc - Release the core of a zombie and its slot
+ */
+static void freeproc(struct proc *p) {
+    if (p->p_addr) {
+        mfree(coremap, USIZE, p->p_addr);
+    }
+    vmfree(p->p_cr3);
+    p->p_addr = 0;
+    p->p_cr3 = 0;
+    p->p_stat = 0;
+    p->p_pid = 0;
+    p->p_ppid = 0;
+    p->p_sig = 0;
+    p->p_exit = 0;
+    p->p_xerr = 0;
+}
+
 /*
  * syswait - Wait for child process
  */
@@ -1260,15 +1460,7 @@ loop:
             if (p->p_stat == SZOMB) {
                 u.u_ar0[R0] = p->p_pid;
                 u.u_ar0[R1] = p->p_exit;
-                if (p->p_addr && p->p_size) {
-                    mfree(coremap, p->p_size, p->p_addr);
-                }
-                p->p_addr = 0;
-                p->p_stat = 0;
-                p->p_pid = 0;
-                p->p_ppid = 0;
-                p->p_sig = 0;
-                p->p_exit = 0;
+                freeproc(p);
                 return 0;
             }
             if (p->p_stat == SSTOP) {
@@ -1323,15 +1515,7 @@ loop:
                     return -1;
                 }
             }
-            if (p->p_addr && p->p_size) {
-                mfree(coremap, p->p_size, p->p_addr);
-            }
-            p->p_addr = 0;
-            p->p_stat = 0;
-            p->p_pid = 0;
-            p->p_ppid = 0;
-            p->p_sig = 0;
-            p->p_exit = 0;
+            freeproc(p);
             return 0;
         }
         if ((options & 2) && p->p_stat == SSTOP) {
@@ -1398,6 +1582,11 @@ int sys_exit(void) {
         p->p_textp = NULL;
     }
 
+    /* Hand a borrowed image back to the parent */
+    if (p->p_flag & SVFORK) {
+        vfdone((uint32_t)kpgdir);
+    }
+
     /* Mark as zombie */
     p->p_stat = SZOMB;
     
@@ -1455,6 +1644,10 @@ void exit(void) {
         p->p_textp = NULL;
     }
 
+    if (p->p_flag & SVFORK) {
+        vfdone((uint32_t)kpgdir);
+    }
+
     /* No swap in this port: keep core allocation until parent waits. */
     p->p_stat = SZOMB;
     for (q = &proc[0]; q < &proc[NPROC]; q++) {
@@ -1482,7 +1675,7 @@ void exit(void) {
 int fork(void) {
     int ret;
 
-    ret = newproc();
+    ret = newproc(0);
     if (ret < 0) {
         u.u_error = EAGAIN;
         goto out;
@@ -1505,6 +1698,143 @@ out:
     return 0;
 }
 
+/*
+ * sys_vfork - vfork system call
+ * The child runs in our image until it calls exec or exit;
+ * we sleep until then, so no page tables are copied.
+ */
+int sys_vfork(void) {
+    int ret, pid;
+
+    ret = newproc(1);
+    if (ret < 0) {
+        u.u_error = EAGAIN;
+        return -1;
+    }
+    if (ret) {
+        u.u_ar0[R0] = 0;
+        u.u_cstime[0] = 0;
+        u.u_cstime[1] = 0;
+        u.u_stime = 0;
+        u.u_cutime[1] = 0;
+        u.u_utime = 0;
+        return 0;
+    }
+    pid = mpid;
+    vfwait(pid);
+    u.u_ar0[R0] = pid;
+    return 0;
+}
+
+/*
+ * spawnact - Carry out n spawn file actions read from the
+ * user array at ap, in the new child before its exec.
+ * Returns -1 with u_error set if one fails.
+ */
+static int spawnact(caddr_t ap, int n) {
+    struct spawnact sa;
+    int fd;
+
+    for (; n > 0; n--, ap += sizeof(sa)) {
+        if (copyin(ap, (caddr_t)&sa, sizeof(sa)) < 0) {
+            u.u_error = EFAULT;
+            return -1;
+        }
+        switch (sa.sa_type) {
+        case SPAWN_CLOSE:
+            u.u_arg[0] = sa.sa_fd;
+            sysclose();
+            break;
+        case SPAWN_DUP2:
+            u.u_arg[0] = sa.sa_fd;
+            u.u_arg[1] = sa.sa_arg;
+            sys_dup2();
+            break;
+        case SPAWN_OPEN:
+        case SPAWN_CREAT:
+            u.u_arg[0] = (uint32_t)sa.sa_path;
+            u.u_arg[1] = sa.sa_arg;
+            if (sa.sa_type == SPAWN_OPEN) {
+                sysopen();
+            } else {
+                creat();
+            }
+            if (u.u_error) {
+                return -1;
+            }
+            fd = u.u_ar0[R0];
+            if (fd != sa.sa_fd) {
+                u.u_arg[0] = fd;
+                u.u_arg[1] = sa.sa_fd;
+                sys_dup2();
+                u.u_arg[0] = fd;
+                sysclose();
+            }
+            break;
+        default:
+            u.u_error = EINVAL;
+        }
+        if (u.u_error) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * sys_spawn - Start a program in a new process
+ * spawn(path, argv, actions, nactions)
+ *
+ * The child is made as by vfork and never returns to the
+ * caller's code: it applies the file actions and execs in
+ * the kernel.  If that fails it exits with status 127 and
+ * the error is returned here in place of its pid.
+ */
+int sys_spawn(void) {
+    struct proc *p;
+    uint32_t path, argv;
+    int ret, pid;
+
+    if (u.u_arg[3] > NOFILE * 3) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    ret = newproc(1);
+    if (ret < 0) {
+        u.u_error = EAGAIN;
+        return -1;
+    }
+    if (ret) {
+        u.u_cstime[0] = 0;
+        u.u_cstime[1] = 0;
+        u.u_stime = 0;
+        u.u_cutime[1] = 0;
+        u.u_utime = 0;
+        path = u.u_arg[0];
+        argv = u.u_arg[1];
+        if (spawnact((caddr_t)u.u_arg[2], u.u_arg[3]) == 0) {
+            u.u_arg[0] = path;
+            u.u_arg[1] = argv;
+            if (exec() == 0) {
+                return 0;
+            }
+        }
+        u.u_procp->p_xerr = u.u_error ? u.u_error : ENOEXEC;
+        u.u_error = 0;
+        u.u_arg[0] = 127 << 8;
+        exit();
+    }
+    pid = mpid;
+    p = vfwait(pid);
+    if (p != NULL && p->p_stat == SZOMB && p->p_xerr) {
+        u.u_error = p->p_xerr;
+        freeproc(p);
+        return -1;
+    }
+    u.u_ar0[R0] = pid;
+    return 0;
+}
+
 /*
  * exec - Execute program
  */
@@ -1566,7 +1896,8 @@ int exec(void) {
     na = 0;
     nc = 0;
     
-    while ((ap = fuword((caddr_t)u.u_arg[1])) != 0) {
+    /* A null argv is taken as an empty one */
+    while (u.u_arg[1] != 0 && (ap = fuword((caddr_t)u.u_arg[1])) != 0) {
         na++;
         if (ap == (uint32_t)-1) {
             u.u_error = EFAULT;
@@ -1577,6 +1908,7 @@ int exec(void) {
         for (;;) {
             c = fubyte((caddr_t)ap++);
             if (c == -1) {
+                u.u_error = EFAULT;
                 goto bad;
             }
             *cp++ = c;
@@ -1640,40 +1972,65 @@ int exec(void) {
         goto bad;
         
     u.u_prof[3] = 0;
+    if (u.u_procp->p_flag & SVFORK) {
+        /* The arguments are in bp; stop borrowing the parent's image */
+        uint32_t pd = vmdup((uint32_t)kpgdir);
+        if (pd == 0) {
+            u.u_error = ENOMEM;
+            goto bad;
+        }
+        vfdone(pd);
+    }
     if (u.u_procp->p_textp) {
         xfree(u.u_procp->p_textp);
         u.u_procp->p_textp = NULL;
     }
+    u.u_procp->p_brk = 0;
     expand(USIZE);
-    if (!raw && header[1] != 0) {
-        xalloc(ip);
+    vmunmap(u.u_procp->p_cr3, USERSIZE - u.u_ssize * 64, USERSIZE);
+    u.u_ssize = 0;
+
+    /*
+     * A flat image (or 0407) loads at 0 straight from the
+     * file, so its pages can be shared with every other
+     * process running it.  Not if someone else has the file
+     * open, as they may be writing it.
+     */
+    if (header[0] == 0407 && ((ip->i_flag & ITEXT) || ip->i_count == 1)) {
+        u.u_procp->p_textp = xalloc(ip, raw ? 0 : 020, header[2]);
     }
     
-    c = USIZE + ds + SSIZE;
+    c = USIZE + ds;
     expand(c);
+    u.u_procp->p_brk = u.u_procp->p_size;
+    if (grow(USERSIZE - SSIZE * 64) == 0) {
+        u.u_error = ENOMEM;
+        goto bad;
+    }
     
     estabur(0, ds, 0, 0);
-    u.u_base = 0;
-    u.u_offset[1] = raw ? 0 : (020 + header[1]);
-    u.u_count = header[2];
-    readi(ip);
+    if (u.u_procp->p_textp == NULL) {
+        u.u_base = 0;
+        u.u_offset[1] = raw ? 0 : (020 + header[1]);
+        u.u_count = header[2];
+        readi(ip);
+    }
     if (u.u_error) {
         goto bad;
     }
     u.u_tsize = ts;
     u.u_dsize = ds;
-    u.u_ssize = SSIZE;
     u.u_sep = sep;
     estabur(u.u_tsize, u.u_dsize, u.u_ssize, u.u_sep);
     
     cp = bp->b_addr;
     {
-        uint32_t stack_top = (ds + SSIZE) * 64;
+        uint32_t stack_top = USERSIZE;
         uint32_t needed = nc + na * 4 + 20; /* argc + argv + NULL + envp NULL + auxv */
         uint32_t argp;
         uint32_t strp;
 
-        if (needed > stack_top) {
+        if (needed > u.u_ssize * 64) {
             u.u_error = E2BIG;
             goto bad;
         }
@@ -1753,7 +2110,7 @@ int exec(void) {
         }
     }
 
-    /* Refresh user segments now that exec may have moved p_addr. */
+    /* Reload the page directory to flush the old image's mappings. */
     update_pos(u.u_procp);
 
     brelse(bp);
@@ -1791,72 +2148,65 @@ bad:
     return -1;
 }
 
-/* Forward declaration for newproc */
-extern int newproc(void);
     
 
 
 /*
  * Machine Dependent Memory Access Functions
- * Replaces assembly routines to handle flat memory model relocation
+ * Replaces assembly routines; user addresses are translated
+ * through the current process's page directory
  */
 
-static uint32_t user_phys_addr(caddr_t addr) {
+static uint32_t user_phys_addr(caddr_t addr, int rw) {
     uint32_t offset = (uint32_t)addr;
     struct proc *p = u.u_procp;
     
-    /* Check limit */
-    if (offset >= (p->p_size - USIZE) * 64) {
+    /*
+     * Check limit: the image at the bottom, the stack at the
+     * top.  Just below the stack it is grown, as a reference
+     * from user mode would (trap 14).
+     */
+    if (offset >= (p->p_size - USIZE) * 64 &&
+        (offset >= USERSIZE ||
+         (offset < USERSIZE - u.u_ssize * 64 && !grow(offset)))) {
         return 0; /* Invalid */
     }
     
-    /* Calculate physical address */
-    /* Base is p_addr + USIZE */
-    return (p->p_addr + USIZE) * 64 + offset;
+    /* Stores bypass page protection, so copy a shared page first */
+    if (rw && vmcow(p->p_cr3, offset) < 0) {
+        return (uint32_t)-1;
+    }
+    
+    return vtop(p->p_cr3, offset);
 }
 
 int fubyte(caddr_t addr) {
-    uint32_t paddr = user_phys_addr(addr);
+    uint32_t paddr = user_phys_addr(addr, 0);
     if (paddr == 0) {
-        /* Check if this is a kernel address (high memory) */
-        /* Kernel space is typically above 0x80000000 or wherever the kernel is loaded */
-        /* For x86, check if it's a reasonable kernel address */
-        uint32_t uaddr = (uint32_t)addr;
-        if (uaddr < 0x1000) {
-            /* Null pointer or other invalid low address */
-            return -1;
-        }
-        /* Assume it's a kernel address and read directly */
-        paddr = uaddr;
+        return -1;
     }
     return *(volatile uint8_t *)paddr;
 }
 
 int fuword(caddr_t addr) {
     uint32_t uaddr = (uint32_t)addr;
-    /* NULL pointer is valid - it marks end of argv array */
-    if (uaddr == 0) {
-        return 0;
-    }
-    
-    uint32_t paddr = user_phys_addr(addr);
+    uint32_t paddr = user_phys_addr(addr, 0);
     if (paddr == 0) {
-        /* Check if this is a kernel address (high memory) */
-        if (uaddr < 0x1000) {
-            /* Invalid low address that's not NULL */
-            return -1;
+        return -1;
+    }
+    if ((uaddr & (PGSIZE - 1)) > PGSIZE - 4) {
+        /* The word straddles two pages, which need not be adjacent */
+        uint32_t w = 0;
+        int i, c;
+        for (i = 3; i >= 0; i--) {
+            if ((c = fubyte(addr + i)) < 0) {
+                return -1;
+            }
+            w = (w << 8) | c;
         }
-        /* Assume it's a kernel address and read directly */
-        paddr = uaddr;
+        return (int)w;
     }
-    /* Check alignment? V6 didn't strictly enforce, but x86 is fine unaligned */
-    return *(volatile uint32_t *)paddr; /* V6 'word' is 16-bit? include/types.h says int is 32-bit? */
-    /* V6 int was 16-bit. Here we use 32-bit for 'word' usually? 
-       Check types.h
-       fuword usually fetches an 'int' or generic word.
-       If userland expects 16-bit, we might have issues.
-       icode uses 32-bit registers (eax). So 32-bit is correct.
-    */
+    return *(volatile uint32_t *)paddr;
 }
 
 int fuiword(caddr_t addr) {
@@ -1864,16 +2214,9 @@ int fuiword(caddr_t addr) {
 }
 
 int subyte(caddr_t addr, int val) {
-    uint32_t paddr = user_phys_addr(addr);
-    if (paddr == 0) {
-        /* Check if this is a kernel address (high memory) */
-        uint32_t uaddr = (uint32_t)addr;
-        if (uaddr < 0x1000) {
-            /* Null pointer or other invalid low address */
-            return -1;
-        }
-        /* Assume it's a kernel address and write directly */
-        paddr = uaddr;
+    uint32_t paddr = user_phys_addr(addr, 1);
+    if (paddr == 0 || paddr == (uint32_t)-1) {
+        return -1;
     }
     *(volatile uint8_t *)paddr = (uint8_t)val;
     return 0;
@@ -1940,6 +2283,7 @@ int ftruncate(void) {
     }
     
     size = u.u_arg[1];
+    plock(ip);
     
     /* Update size fields */
     ip->i_size0 = (size >> 16) & 0xFF;
@@ -1950,14 +2294,19 @@ int ftruncate(void) {
     
     /* Free blocks beyond new size */
     itrunc(ip);
+    prele(ip);
     
     return 0;
 }
 
 /*
- * fsync - Synchronize file to disk
+ * fsyncf - Put an open file's blocks on disk, then its inode
+ * unless only the data was asked for and the size and block
+ * map are unchanged.  On a journaled file system the inode
+ * joins the running transaction and one commit puts it on
+ * the log.
  */
-int fsync(void) {
+static int fsyncf(int datasync) {
     struct file *fp;
     struct inode *ip;
     
@@ -1967,14 +2316,39 @@ int fsync(void) {
     }
     
     ip = fp->f_inode;
+    bsyncip(ip);
+    if (ip->i_error) {
+        u.u_error = ip->i_error;
+        ip->i_error = 0;
+        return -1;
+    }
+    if (datasync && (ip->i_flag & ISIZE) == 0) {
+        return 0;
+    }
     
-    /* Mark inode for update and call sync */
+    plock(ip);
     ip->i_flag |= IUPD;
-    update();
+    iupdat(ip, time);
+    prele(ip);
+    jcommit(ip->i_dev);
     
     return 0;
 }
 
+/*
+ * fsync - Synchronize file to disk
+ */
+int fsync(void) {
+    return fsyncf(0);
+}
+
+/*
+ * fdatasync - Synchronize file data to disk
+ */
+int sys_fdatasync(void) {
+    return fsyncf(1);
+}
+
 /*
  * utime - Update file times
  */
@@ -1996,8 +2370,18 @@ int utime(void) {
 }
 
 int suword(caddr_t addr, int val) {
-    uint32_t paddr = user_phys_addr(addr);
-    if (paddr == 0) return -1;
+    uint32_t paddr = user_phys_addr(addr, 1);
+    if (paddr == 0 || paddr == (uint32_t)-1) return -1;
+    if (((uint32_t)addr & (PGSIZE - 1)) > PGSIZE - 4) {
+        /* The word straddles two pages, which need not be adjacent */
+        int i;
+        for (i = 0; i < 4; i++) {
+            if (subyte(addr + i, (uint32_t)val >> (8 * i)) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
     *(volatile uint32_t *)paddr = val;
     return 0;
 }
@@ -2227,90 +2611,284 @@ int sys_unlink(void) {
 }
 
 /*
- * sys_rename - Rename file (syscall #63)
+ * dir_empty - Check if directory has entries other than "." and ".."
  */
-int sys_rename(void) {
-    uint32_t oldp = u.u_arg[0];
-    uint32_t newp = u.u_arg[1];
-    int ret;
+static int dir_empty(struct inode *ip) {
+    char name[MAXNAMLEN + 1];
+    off_t off = 0;
+    ino_t ino;
+    int n;
     
-    /* Try link old -> new */
-    u.u_arg[0] = oldp;
-    u.u_arg[1] = newp;
-    ret = link();
-    if (ret < 0 && u.u_error == EEXIST) {
-        /* Remove existing destination and retry */
-        u.u_error = 0;
-        u.u_arg[0] = newp;
-        if (unlink() < 0) {
-            return -1;
+    while ((n = dirread(ip, &off, &ino, name, NULL)) > 0) {
+        if (name[0] == '.' &&
+            (n == 1 || (n == 2 && name[1] == '.'))) {
+            continue;
         }
-        u.u_arg[0] = oldp;
-        u.u_arg[1] = newp;
-        ret = link();
+        return 0;
     }
-    if (ret < 0) {
-        return -1;
+    return n == 0;
+}
+
+/*
+ * isdotname - Is the last name gathered by namei "." or ".."?
+ */
+static int isdotname(void) {
+    return u.u_dbuf[0] == '.' &&
+           (u.u_namlen == 1 || (u.u_namlen == 2 && u.u_dbuf[1] == '.'));
+}
+
+/*
+ * rntarget - Check that xp, the existing file named by the
+ * last namei, may be replaced by ip; sets u_error if not
+ */
+static void rntarget(struct inode *ip, struct inode *xp, int isdir) {
+    if (xp->i_dev != ip->i_dev) {
+        u.u_error = EXDEV;
+    } else if ((xp->i_mode & IFMT) == IFDIR) {
+        if (!isdir) {
+            u.u_error = EISDIR;
+        } else if (isdotname() || !dir_empty(xp)) {
+            if (u.u_error == 0) {
+                u.u_error = EBUSY;
+            }
+        }
+    } else if (isdir) {
+        u.u_error = ENOTDIR;
     }
-    
-    /* Remove old name */
-    u.u_arg[0] = oldp;
-    if (unlink() < 0) {
-        return -1;
+}
+
+/*
+ * rnparent - Check that ip may be entered in directory dp,
+ * having been in directory opino; sets u_error if not.
+ * A directory may not be moved beneath itself.
+ */
+static void rnparent(struct inode *ip, struct inode *dp, ino_t opino, int isdir) {
+    struct inode *xp;
+    ino_t ino;
+
+    if (dp->i_dev != ip->i_dev) {
+        u.u_error = EXDEV;
+        return;
+    }
+    if (!isdir || dp->i_number == opino) {
+        return;
+    }
+    ino = dp->i_number;
+    while (ino != ROOTINO && ino != 0 && u.u_error == 0) {
+        if (ino == ip->i_number) {
+            u.u_error = EINVAL;
+            break;
+        }
+        if (ino == dp->i_number) {
+            ino = dirfind(dp, "..");
+        } else {
+            xp = iget(dp->i_dev, ino);
+            if (xp == NULL) {
+                break;
+            }
+            ino = dirfind(xp, "..");
+            iput(xp);
+        }
     }
-    
-    u.u_ar0[EAX] = 0;
-    return 0;
 }
 
 /*
- * dir_empty - Check if directory has entries other than "." and ".."
+ * sys_rename - Rename file (syscall #63)
+ *
+ * Every check is made before anything is changed.  The new
+ * name is entered before the old one is removed, so the
+ * file always has a name.  A directory moved to a new parent
+ * has its ".." repointed and the parents' link counts adjusted.
  */
-static int dir_empty(struct inode *ip) {
-    struct buf *bp = NULL;
-    int size = ((ip->i_size0 & 0xFF) << 16) | ip->i_size1;
-    int off = 0;
+int sys_rename(void) {
+    struct inode *ip, *xp, *dp;
+    ino_t opino, npino;
+    int isdir;
     
-    struct direct {
-        ino_t d_ino;
-        char d_name[DIRSIZ];
-    };
+    /* Look up the source */
+    u.u_dirp = (caddr_t)u.u_arg[0];
+    ip = namei(uchar, 2);
+    if (ip == NULL) {
+        return -1;
+    }
+    if (isdotname()) {
+        iput(ip);
+        iput(u.u_pdir);
+        u.u_pdir = NULL;
+        u.u_error = EINVAL;
+        return -1;
+    }
+    opino = u.u_pdir->i_number;
+    iput(u.u_pdir);
+    u.u_pdir = NULL;
+    isdir = (ip->i_mode & IFMT) == IFDIR;
+    if (isdir) {
+        cwdgen++;
+    }
     
-    while (off < size) {
-        if ((off & (BSIZE - 1)) == 0) {
-            if (bp) {
-                brelse(bp);
-            }
-            bp = bread(ip->i_dev, bmap(ip, off / BSIZE, 0));
-            if (bp == NULL || (bp->b_flags & B_ERROR)) {
-                if (bp) {
-                    brelse(bp);
-                }
-                return 0;
-            }
+    /* Hold an extra link while the file is between names */
+    ip->i_nlink++;
+    ip->i_flag |= IUPD;
+    prele(ip);
+    
+    /* Check the target and its directory */
+    u.u_dirp = (caddr_t)u.u_arg[1];
+    xp = namei(uchar, 2);
+    if (xp != NULL) {
+        dp = u.u_pdir;
+        u.u_pdir = NULL;
+        if (xp == ip) {
+            /* Both names already refer to the same file */
+            iput(xp);
+            iput(dp);
+            goto done;
         }
-        
-        struct direct *dp = (struct direct *)(bp->b_addr + (off & (BSIZE - 1)));
-        off += (DIRSIZ + 2);
-        
-        if (dp->d_ino == 0) {
-            continue;
+        rntarget(ip, xp, isdir);
+        iput(xp);
+    } else if (u.u_error != ENOENT) {
+        goto bad;
+    } else {
+        u.u_error = 0;
+        xp = namei(uchar, 1);
+        if (xp != NULL) {
+            iput(xp);
+            u.u_error = EEXIST;
+            goto bad;
+        }
+        if (u.u_error) {
+            goto bad;
+        }
+        dp = u.u_pdir;
+        u.u_pdir = NULL;
+    }
+    if (u.u_error == 0) {
+        rnparent(ip, dp, opino, isdir);
+    }
+    iput(dp);
+    if (u.u_error) {
+        goto bad;
+    }
+    
+    /* Remove an existing target */
+    u.u_dirp = (caddr_t)u.u_arg[1];
+    xp = namei(uchar, 2);
+    if (xp != NULL) {
+        dp = u.u_pdir;
+        u.u_pdir = NULL;
+        if (xp == ip) {
+            u.u_error = EBUSY;
+        } else {
+            rntarget(ip, xp, isdir);
+        }
+        if (u.u_error == 0) {
+            u.u_pdir = dp;
+            dirremove();
+            u.u_pdir = NULL;
+        }
+        if (u.u_error) {
+            iput(xp);
+            iput(dp);
+            goto bad;
+        }
+        if ((xp->i_mode & IFMT) == IFDIR) {
+            itrunc(xp);
+            xp->i_nlink = 0;
+            dp->i_nlink--;
+            dp->i_flag |= ICHG;
+        } else {
+            xp->i_nlink--;
         }
+        xp->i_flag |= IUPD | ICHG;
+        xp->i_ctime = time[1];
+        iput(xp);
+        iput(dp);
+    } else if (u.u_error != ENOENT) {
+        goto bad;
+    }
+    u.u_error = 0;
+    
+    /* Find the slot for the new name */
+    u.u_dirp = (caddr_t)u.u_arg[1];
+    xp = namei(uchar, 1);
+    if (xp != NULL) {
+        iput(xp);
+        u.u_error = EEXIST;
+        goto bad;
+    }
+    if (u.u_error) {
+        goto bad;
+    }
+    dp = u.u_pdir;
+    if (dp->i_dev != ip->i_dev) {
+        iput(dp);
+        u.u_pdir = NULL;
+        u.u_error = EXDEV;
+        goto bad;
+    }
+    npino = dp->i_number;
+    
+    /* Enter the new name; wdir releases the parent */
+    wdir(ip);
+    u.u_pdir = NULL;
+    if (u.u_error) {
+        goto bad;
+    }
+    
+    /* Remove the old name */
+    u.u_dirp = (caddr_t)u.u_arg[0];
+    xp = namei(uchar, 2);
+    if (xp == NULL) {
+        goto bad;
+    }
+    dp = u.u_pdir;
+    u.u_pdir = NULL;
+    if (xp == ip) {
+        u.u_pdir = dp;
+        dirremove();
+        u.u_pdir = NULL;
+    }
+    iput(xp);
+    
+    if (isdir && npino != opino && u.u_error == 0) {
+        /* Old parent loses the ".." link, new parent gains it */
+        dp->i_nlink--;
+        dp->i_flag |= ICHG;
+        dp->i_ctime = time[1];
+        iput(dp);
         
-        if (dp->d_name[0] == '.' &&
-            (dp->d_name[1] == '\0' ||
-             (dp->d_name[1] == '.' && dp->d_name[2] == '\0'))) {
-            continue;
+        dp = iget(ip->i_dev, npino);
+        if (dp != NULL) {
+            dp->i_nlink++;
+            dp->i_flag |= ICHG;
+            dp->i_ctime = time[1];
+            iput(dp);
         }
         
-        brelse(bp);
-        return 0;
+        xp = iget(ip->i_dev, ip->i_number);
+        if (xp != NULL) {
+            dirrepoint(xp, "..", npino);
+            iput(xp);
+        }
+    } else {
+        iput(dp);
     }
-    
-    if (bp) {
-        brelse(bp);
+    if (u.u_error) {
+        goto bad;
     }
-    return 1;
+    
+done:
+    ip->i_nlink--;
+    ip->i_flag |= IUPD | ICHG;
+    ip->i_ctime = time[1];
+    iput(ip);
+    u.u_ar0[EAX] = 0;
+    return 0;
+
+bad:
+    ip->i_nlink--;
+    ip->i_flag |= IUPD;
+    iput(ip);
+    return -1;
 }
 
 /*
@@ -2360,33 +2938,10 @@ int sys_mkdir(void) {
     ip->i_mtime = time[1];
     ip->i_ctime = time[1];
 
-    /* Write "." and ".." into the new directory */
-    struct {
-        ino_t d_ino;
-        char  d_name[DIRSIZ];
-    } dirbuf[2];
-
-    for (int i = 0; i < DIRSIZ; i++) {
-        dirbuf[0].d_name[i] = 0;
-        dirbuf[1].d_name[i] = 0;
-    }
-
-    dirbuf[0].d_ino = ip->i_number;
-    dirbuf[0].d_name[0] = '.';
-
-    dirbuf[1].d_ino = dp->i_number;
-    dirbuf[1].d_name[0] = '.';
-    dirbuf[1].d_name[1] = '.';
-
-    u.u_offset[0] = 0;
-    u.u_offset[1] = 0;
-    u.u_base   = (caddr_t)dirbuf;
-    u.u_count  = sizeof(dirbuf);
-    u.u_segflg = 1;
-
-    writei(ip);
-    if (u.u_error) {
+    /* Lay out the new directory in hashed form with "." and ".." */
+    if (dxinit(ip, dp->i_number) < 0) {
         /* rollback new inode */
+        itrunc(ip);
         ip->i_nlink = 0;
         ip->i_flag |= ICHG;
         iput(ip);
@@ -2396,13 +2951,6 @@ int sys_mkdir(void) {
         return -1;
     }
 
-    /* Explicitly update size if writei didn't */
-    if (ip->i_size1 < sizeof(dirbuf)) {
-        ip->i_size0 = 0;
-        ip->i_size1 = sizeof(dirbuf);
-        ip->i_flag |= IUPD;
-    }
-
     /*
      * Add entry in parent.
      * wdir(ip) typically uses u.u_pdir and u.u_dent info from namei().
@@ -2459,10 +3007,8 @@ int sys_rmdir(void) {
         return -1;
     }
 
-    /* don't remove "." or ".." (depends on how namei stores the found name) */
-    /* If you have u.u_dent name available, check it here. */
-    if (u.u_dent.u_name[0] == '.' &&
-        (u.u_dent.u_name[1] == '\0' || (u.u_dent.u_name[1] == '.' && u.u_dent.u_name[2] == '\0'))) {
+    /* don't remove "." or ".." */
+    if (isdotname()) {
         iput(ip);
         if (u.u_pdir) { iput(u.u_pdir); u.u_pdir = NULL; }
         u.u_error = EINVAL;
@@ -2478,17 +3024,7 @@ int sys_rmdir(void) {
     }
 
     /* Clear directory entry in parent */
-    /* IMPORTANT: subtract the entry size from the full offset correctly in your kernel */
-    /* entry size is (DIRSIZ + sizeof(ino_t)) => often DIRSIZ+2 */
-    /* If u.u_offset is split-high/low, use proper subtract helper. */
-    u.u_offset[1] -= (DIRSIZ + 2);   /* <-- replace with proper lsub() if needed */
-
-    u.u_base = (caddr_t)&u.u_dent;
-    u.u_count = DIRSIZ + 2;
-    u.u_dent.u_ino = 0;
-    u.u_segflg = 1;
-
-    writei(u.u_pdir);
+    dirremove();
     if (u.u_error) {
         iput(ip);
         if (u.u_pdir) { iput(u.u_pdir); u.u_pdir = NULL; }
@@ -2505,6 +3041,7 @@ int sys_rmdir(void) {
     }
 
     /* Drop the directory inode */
+    cwdgen++;
     itrunc(ip);
     ip->i_nlink = 0;
     ip->i_flag |= ICHG;
@@ -2537,6 +3074,43 @@ int sys_umask(void) {
     return 0;
 }
 
+/*
+ * growbrk - Make the image reach a break of nd data clicks
+ *
+ * The image is grown half as much again as it needs, so a
+ * heap built by many small sbrk calls expands only a few
+ * times; it is cut back once the break falls below half of
+ * what is reserved.  The heap never reaches into the range
+ * kept for the stack.
+ */
+static int growbrk(int nd) {
+    struct proc *p = u.u_procp;
+    uint32_t n, r, lim;
+
+    n = USIZE + u.u_tsize + nd;
+    lim = USIZE + USERSIZE / 64 - STKMAX;
+    if (n > lim) {
+        u.u_error = ENOMEM;
+        return -1;
+    }
+    if (n > p->p_size) {
+        r = n + (n - USIZE) / 2;
+        expand(r < lim ? r : lim);
+        if (u.u_error) {
+            /* No room for the reserve; try for what is needed */
+            u.u_error = 0;
+            expand(n);
+            if (u.u_error) {
+                return -1;
+            }
+        }
+    } else if (n - USIZE < (p->p_size - USIZE) / 2) {
+        expand(n + (n - USIZE) / 2);
+    }
+    p->p_brk = n;
+    return 0;
+}
+
 /*
  * sys_brk - Set data segment limit (syscall #68)
  */
@@ -2561,6 +3135,9 @@ int sys_brk(void) {
     if (estabur(u.u_tsize, new_dsize, u.u_ssize, 0) < 0) {
         return -1;
     }
+    if (growbrk(new_dsize) < 0) {
+        return -1;
+    }
     
     u.u_dsize = new_dsize;
     u.u_ar0[EAX] = 0;
@@ -2587,6 +3164,9 @@ int sys_sbrk(void) {
     if (estabur(u.u_tsize, new_dsize, u.u_ssize, 0) < 0) {
         return -1;
     }
+    if (growbrk(new_dsize) < 0) {
+        return -1;
+    }
     
     u.u_dsize = new_dsize;
     u.u_ar0[EAX] = old;
@@ -3321,6 +3901,9 @@ int sys_mmap(void) {
         u.u_error = ENOMEM;
         return -1;
     }
+    if (growbrk(u.u_dsize + (len + 63) / 64) < 0) {
+        return -1;
+    }
     
     u.u_dsize += (len + 63) / 64;
     
@@ -3505,13 +4088,316 @@ int sys_shmdt(void) {
     return -1;
 }
 
+/*
+ * sys_copy_file_range - Copy between files in the kernel (syscall #124)
+ *
+ * copy_file_range(fd_in, off_in, fd_out, off_out, len, flags).
+ * An offset pointer that is NULL means the file offset, which
+ * is then advanced; otherwise the offset is read from and
+ * written back to the user.  Both must be regular files.
+ */
 int sys_copy_file_range(void) {
-    u.u_error = ENOSYS;
-    return -1;
-}
-
-int sys_epoll_create1(void) {
-    u.u_error = ENOSYS;
+    struct file *sfp, *dfp;
+    struct inode *sip, *dip;
+    off_t soff, doff;
+    caddr_t sop, dop;
+    int count, n;
+    
+    sfp = getf(u.u_arg[0]);
+    dfp = getf(u.u_arg[2]);
+    if (sfp == NULL || dfp == NULL) {
+        return -1;
+    }
+    if ((sfp->f_flag & FREAD) == 0 || (dfp->f_flag & FWRITE) == 0 ||
+        (dfp->f_flag & FAPPEND)) {
+        u.u_error = EBADF;
+        return -1;
+    }
+    sip = sfp->f_inode;
+    dip = dfp->f_inode;
+    if (((sfp->f_flag | dfp->f_flag) & FPIPE) || u.u_arg[5] != 0 ||
+        (sip->i_mode & IFMT) != IFREG || (dip->i_mode & IFMT) != IFREG) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    
+    sop = (caddr_t)u.u_arg[1];
+    dop = (caddr_t)u.u_arg[3];
+    soff = sfp->f_offset[1];
+    doff = dfp->f_offset[1];
+    if ((sop && copyin(sop, (caddr_t)&soff, sizeof(soff)) < 0) ||
+        (dop && copyin(dop, (caddr_t)&doff, sizeof(doff)) < 0)) {
+        u.u_error = EFAULT;
+        return -1;
+    }
+    count = u.u_arg[4];
+    if (soff < 0 || doff < 0 || count < 0) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    
+    /* Overlapping ranges of one file are refused, as on Linux */
+    if (sip == dip && soff < doff + count && doff < soff + count) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    
+    /*
+     * Both files are locked, the lower address first so that
+     * two copies in opposite directions cannot deadlock.
+     */
+    if (sip < dip) {
+        plock(sip);
+    }
+    plock(dip);
+    if (sip > dip) {
+        plock(sip);
+    }
+    n = copyi(sip, soff, dip, doff, count);
+    if (sip != dip) {
+        prele(sip);
+    }
+    prele(dip);
+    if (n == 0 && u.u_error) {
+        return -1;
+    }
+    u.u_error = 0;
+    
+    soff += n;
+    doff += n;
+    if (sop) {
+        copyout((caddr_t)&soff, sop, sizeof(soff));
+    } else {
+        sfp->f_offset[1] = soff;
+    }
+    if (dop) {
+        copyout((caddr_t)&doff, dop, sizeof(doff));
+    } else {
+        dfp->f_offset[1] = doff;
+    }
+    u.u_ar0[EAX] = n;
+    return n;
+}
+
+/*
+ * spliceoff - Fetch the offset for one end of splice or sendfile
+ * A NULL pointer means the file offset.
+ */
+static int spliceoff(struct file *fp, caddr_t op, off_t *offp) {
+    *offp = fp->f_offset[1];
+    if (op && copyin(op, (caddr_t)offp, sizeof(*offp)) < 0) {
+        u.u_error = EFAULT;
+        return -1;
+    }
+    if (*offp < 0) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * splicedone - Advance an offset fetched by spliceoff
+ */
+static void splicedone(struct file *fp, caddr_t op, off_t off) {
+    if (op) {
+        copyout((caddr_t)&off, op, sizeof(off));
+    } else {
+        fp->f_offset[1] = off;
+    }
+}
+
+/*
+ * sys_splice - Move data to or from a pipe (syscall #355)
+ *
+ * splice(fd_in, off_in, fd_out, off_out, len, flags).
+ * One end must be a pipe; the other may be a regular file,
+ * or a character device when it is written.  The data moves
+ * between cache buffers in the kernel.  Flags are hints and
+ * are ignored.
+ */
+int sys_splice(void) {
+    struct file *sfp, *dfp;
+    struct inode *sip, *dip;
+    caddr_t sop, dop;
+    off_t off;
+    int count, n;
+    
+    sfp = getf(u.u_arg[0]);
+    dfp = getf(u.u_arg[2]);
+    if (sfp == NULL || dfp == NULL) {
+        return -1;
+    }
+    if ((sfp->f_flag & FREAD) == 0 || (dfp->f_flag & FWRITE) == 0) {
+        u.u_error = EBADF;
+        return -1;
+    }
+    sip = sfp->f_inode;
+    dip = dfp->f_inode;
+    sop = (caddr_t)u.u_arg[1];
+    dop = (caddr_t)u.u_arg[3];
+    count = u.u_arg[4];
+    if (count < 0) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    if (((sfp->f_flag & FPIPE) && sop) || ((dfp->f_flag & FPIPE) && dop)) {
+        u.u_error = ESPIPE;
+        return -1;
+    }
+    if (count == 0) {
+        u.u_ar0[EAX] = 0;
+        return 0;
+    }
+    
+    if ((sfp->f_flag & FPIPE) && (dfp->f_flag & FPIPE)) {
+        if (sip == dip) {
+            u.u_error = EINVAL;
+            return -1;
+        }
+        n = pipecopy(sfp, dfp, count, 1);
+    } else if (sfp->f_flag & FPIPE) {
+        if ((dip->i_mode & IFMT) != IFREG && (dip->i_mode & IFMT) != IFCHR) {
+            u.u_error = EINVAL;
+            return -1;
+        }
+        if (spliceoff(dfp, dop, &off) < 0) {
+            return -1;
+        }
+        if ((dfp->f_flag & FAPPEND) && dop == NULL) {
+            off = ((dip->i_size0 & 0xFF) << 16) | dip->i_size1;
+        }
+        n = pipeout(sfp, dip, off, count);
+        splicedone(dfp, dop, off + n);
+    } else if (dfp->f_flag & FPIPE) {
+        if ((sip->i_mode & IFMT) != IFREG) {
+            u.u_error = EINVAL;
+            return -1;
+        }
+        if (spliceoff(sfp, sop, &off) < 0) {
+            return -1;
+        }
+        n = pipein(dfp, sip, off, count);
+        splicedone(sfp, sop, off + n);
+    } else {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    
+    if (n == 0 && u.u_error) {
+        return -1;
+    }
+    u.u_error = 0;
+    u.u_ar0[EAX] = n;
+    return n;
+}
+
+/*
+ * sys_tee - Duplicate pipe data into another pipe (syscall #368)
+ *
+ * tee(fd_in, fd_out, len, flags).  The data stays in the
+ * first pipe for its own reader.
+ */
+int sys_tee(void) {
+    struct file *sfp, *dfp;
+    int count, n;
+    
+    sfp = getf(u.u_arg[0]);
+    dfp = getf(u.u_arg[1]);
+    if (sfp == NULL || dfp == NULL) {
+        return -1;
+    }
+    if ((sfp->f_flag & FREAD) == 0 || (dfp->f_flag & FWRITE) == 0) {
+        u.u_error = EBADF;
+        return -1;
+    }
+    count = u.u_arg[2];
+    if ((sfp->f_flag & dfp->f_flag & FPIPE) == 0 ||
+        sfp->f_inode == dfp->f_inode || count < 0) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    
+    n = 0;
+    if (count > 0) {
+        n = pipecopy(sfp, dfp, count, 0);
+        if (n == 0 && u.u_error) {
+            return -1;
+        }
+    }
+    u.u_error = 0;
+    u.u_ar0[EAX] = n;
+    return n;
+}
+
+/*
+ * sys_sendfile - Send a file to a pipe, file or device (syscall #323)
+ *
+ * sendfile(out_fd, in_fd, offset, count).  With offset NULL
+ * the input file's offset is used and advanced; otherwise
+ * *offset is, and the file offset is left alone.
+ */
+int sys_sendfile(void) {
+    struct file *sfp, *dfp;
+    struct inode *sip, *dip;
+    caddr_t sop;
+    off_t soff, doff;
+    int count, n;
+    
+    dfp = getf(u.u_arg[0]);
+    sfp = getf(u.u_arg[1]);
+    if (sfp == NULL || dfp == NULL) {
+        return -1;
+    }
+    if ((sfp->f_flag & FREAD) == 0 || (dfp->f_flag & FWRITE) == 0) {
+        u.u_error = EBADF;
+        return -1;
+    }
+    sip = sfp->f_inode;
+    dip = dfp->f_inode;
+    count = u.u_arg[3];
+    if ((sfp->f_flag & FPIPE) || (sip->i_mode & IFMT) != IFREG ||
+        sip == dip || count < 0) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    sop = (caddr_t)u.u_arg[2];
+    if (spliceoff(sfp, sop, &soff) < 0) {
+        return -1;
+    }
+    
+    if (dfp->f_flag & FPIPE) {
+        n = pipein(dfp, sip, soff, count);
+    } else {
+        if ((dip->i_mode & IFMT) != IFREG && (dip->i_mode & IFMT) != IFCHR) {
+            u.u_error = EINVAL;
+            return -1;
+        }
+        if ((dip->i_mode & IFMT) == IFREG) {
+            plock(dip);
+        }
+        doff = dfp->f_offset[1];
+        if (dfp->f_flag & FAPPEND) {
+            doff = ((dip->i_size0 & 0xFF) << 16) | dip->i_size1;
+        }
+        n = copyi(sip, soff, dip, doff, count);
+        dfp->f_offset[1] = doff + n;
+        if ((dip->i_mode & IFMT) == IFREG) {
+            prele(dip);
+        }
+    }
+    if (n == 0 && u.u_error) {
+        return -1;
+    }
+    u.u_error = 0;
+    
+    splicedone(sfp, sop, soff + n);
+    u.u_ar0[EAX] = n;
+    return n;
+}
+
+int sys_epoll_create1(void) {
+    u.u_error = ENOSYS;
     return -1;
 }
 
@@ -3525,9 +4411,128 @@ int sys_epoll_pwait(void) {
     return -1;
 }
 
+/*
+ * getdents1 - Common code of getdents and readdirplus
+ *
+ * Fills the buffer with as many live entries as fit, as
+ * struct gdirent records, whatever the directory's format
+ * on disk; with plus each is preceded by the file's status.
+ * Returns the number of bytes filled, 0 at the end.
+ */
+static int getdents1(int plus) {
+    struct file *fp;
+    struct inode *ip;
+    struct inode ic;
+    struct gdirent de;
+    struct pdirstat ps;
+    caddr_t base;
+    off_t off, last;
+    ino_t ino;
+    int count, total, n, type, reclen, hdr, i;
+    
+    fp = getf(u.u_arg[0]);
+    if (fp == NULL) {
+        return -1;
+    }
+    ip = fp->f_inode;
+    if ((fp->f_flag & FREAD) == 0 || (fp->f_flag & FPIPE)) {
+        u.u_error = EBADF;
+        return -1;
+    }
+    if ((ip->i_mode & IFMT) != IFDIR) {
+        u.u_error = ENOTDIR;
+        return -1;
+    }
+    base = (caddr_t)u.u_arg[1];
+    count = u.u_arg[2];
+    hdr = plus ? sizeof(ps) : 0;
+    
+    plock(ip);
+    off = fp->f_offset[1];
+    total = 0;
+    for (;;) {
+        last = off;
+        n = dirread(ip, &off, &ino, de.d_name, &type);
+        if (n <= 0) {
+            break;
+        }
+        reclen = hdr + GDIRSIZ(n);
+        if (total + reclen > count) {
+            off = last;
+            if (total == 0) {
+                u.u_error = EINVAL;
+            }
+            break;
+        }
+        de.d_ino = ino;
+        de.d_off = off;
+        de.d_reclen = reclen;
+        de.d_namlen = n;
+        de.d_type = type;
+        for (i = n + 1; hdr + GDIRHDR + i < reclen; i++) {
+            de.d_name[i] = '\0';
+        }
+        
+        /* The inode is looked at, not locked, so no lock order is at stake */
+        if (plus) {
+            if (ipeek(ip->i_dev, ino, &ic) < 0) {
+                ic.i_dev = ip->i_dev;
+                ic.i_number = ino;
+                ic.i_mode = 0;
+                ic.i_nlink = 0;
+                ic.i_uid = 0;
+                ic.i_gid = 0;
+                ic.i_addr[0] = 0;
+                ic.i_size0 = 0;
+                ic.i_size1 = 0;
+                ic.i_atime = ic.i_mtime = ic.i_ctime = 0;
+            }
+            ps.p_dev = ic.i_dev;
+            ps.p_ino = ic.i_number;
+            ps.p_mode = ic.i_mode;
+            ps.p_nlink = ic.i_nlink;
+            ps.p_uid = ic.i_uid;
+            ps.p_gid = ic.i_gid;
+            ps.p_rdev = ic.i_addr[0];
+            ps.p_pad = 0;
+            ps.p_size = ((ic.i_size0 & 0xFF) << 16) | ic.i_size1;
+            ps.p_atime = ic.i_atime;
+            ps.p_mtime = ic.i_mtime;
+            ps.p_ctime = ic.i_ctime;
+        }
+        if ((plus && copyout((caddr_t)&ps, base + total, hdr) < 0) ||
+            copyout((caddr_t)&de, base + total + hdr, reclen - hdr) < 0) {
+            off = last;
+            u.u_error = EFAULT;
+            break;
+        }
+        total += reclen;
+    }
+    fp->f_offset[1] = off;
+    iatime(ip);
+    prele(ip);
+    
+    if (u.u_error && total == 0) {
+        return -1;
+    }
+    u.u_error = 0;
+    u.u_ar0[EAX] = total;
+    return total;
+}
+
+/*
+ * sys_getdents - Read directory entries (syscall #128)
+ */
 int sys_getdents(void) {
-    u.u_error = ENOSYS;
-    return -1;
+    return getdents1(0);
+}
+
+/*
+ * sys_readdirplus - Read directory entries with the status
+ * of each file, saving ls a stat per name (syscall #40)
+ */
+int sys_readdirplus(void) {
+    return getdents1(1);
 }
 
 int sys_getitimer(void) {
@@ -3565,9 +4570,67 @@ int sys_fanotify_mark(void) {
     return -1;
 }
 
+/*
+ * sys_fallocate - Allocate blocks ahead of writes (syscall #136)
+ *
+ * fallocate(fd, mode, offset, len).  Holes in the range are
+ * given zeroed blocks, contiguous where the free list allows.
+ * The file grows to cover the range unless mode has
+ * FALLOC_FL_KEEP_SIZE.  No other modes are supported.
+ */
 int sys_fallocate(void) {
-    u.u_error = ENOSYS;
-    return -1;
+    struct file *fp;
+    struct inode *ip;
+    uint32_t end, size;
+    daddr_t lbn;
+    off_t off, len;
+    
+    fp = getf(u.u_arg[0]);
+    if (fp == NULL) {
+        return -1;
+    }
+    if ((fp->f_flag & FWRITE) == 0) {
+        u.u_error = EBADF;
+        return -1;
+    }
+    if (fp->f_flag & FPIPE) {
+        u.u_error = ESPIPE;
+        return -1;
+    }
+    ip = fp->f_inode;
+    if ((ip->i_mode & IFMT) != IFREG) {
+        u.u_error = ENODEV;
+        return -1;
+    }
+    off = u.u_arg[2];
+    len = u.u_arg[3];
+    if ((u.u_arg[1] & ~FALLOC_FL_KEEP_SIZE) || off < 0 || len <= 0) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    end = (uint32_t)off + len;
+    if (end < (uint32_t)off || end > 0xFFFFFF) {
+        u.u_error = EFBIG;
+        return -1;
+    }
+    
+    plock(ip);
+    lbn = off >> BSHIFT;
+    if (iprealloc(ip, lbn, ((end + BMASK) >> BSHIFT) - lbn) < 0) {
+        prele(ip);
+        return -1;
+    }
+    
+    size = ((ip->i_size0 & 0xFF) << 16) | ip->i_size1;
+    if ((u.u_arg[1] & FALLOC_FL_KEEP_SIZE) == 0 && end > size) {
+        ip->i_size0 = (end >> 16) & 0xFF;
+        ip->i_size1 = end & 0xFFFF;
+        ip->i_ctime = time[1];
+        ip->i_flag |= IUPD | ISIZE;
+    }
+    prele(ip);
+    u.u_ar0[EAX] = 0;
+    return 0;
 }
 
 int sys_rt_sigaction(void) {
@@ -3585,9 +4648,112 @@ int sys_exit_group(void) {
     return -1;
 }
 
+/*
+ * fadvrange - Blocks of a file covered by offset and length
+ * A length of 0 reaches the end of the file.
+ */
+static int fadvrange(struct inode *ip, off_t off, off_t len, daddr_t *lbnp) {
+    uint32_t end;
+    
+    if (off < 0 || len < 0) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    if (len == 0) {
+        end = ((ip->i_size0 & 0xFF) << 16) | ip->i_size1;
+    } else {
+        end = (uint32_t)off + len;
+    }
+    *lbnp = off >> BSHIFT;
+    if (end <= (uint32_t)off) {
+        return 0;
+    }
+    return ((end + BMASK) >> BSHIFT) - *lbnp;
+}
+
+/*
+ * sys_fadvise - Declare how a file will be read (syscall #140)
+ *
+ * fadvise(fd, offset, len, advice).  NORMAL, RANDOM,
+ * SEQUENTIAL and NOREUSE set the read-ahead of the file,
+ * which all its opens share; WILLNEED starts reading the
+ * range and DONTNEED drops its clean blocks from the cache.
+ */
 int sys_fadvise(void) {
-    u.u_error = ENOSYS;
-    return -1;
+    struct file *fp;
+    struct inode *ip;
+    daddr_t lbn;
+    int n;
+    
+    fp = getf(u.u_arg[0]);
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fp->f_flag & FPIPE) {
+        u.u_error = ESPIPE;
+        return -1;
+    }
+    ip = fp->f_inode;
+    n = fadvrange(ip, u.u_arg[1], u.u_arg[2], &lbn);
+    if (n < 0) {
+        return -1;
+    }
+    
+    switch (u.u_arg[3]) {
+    case FADV_NORMAL:
+    case FADV_RANDOM:
+    case FADV_SEQUENTIAL:
+    case FADV_NOREUSE:
+        ip->i_advice = u.u_arg[3];
+        break;
+    case FADV_WILLNEED:
+        rahead(ip, lbn, n < NWILLNEED ? n : NWILLNEED);
+        break;
+    case FADV_DONTNEED:
+        idrop(ip, lbn, n);
+        break;
+    default:
+        u.u_error = EINVAL;
+        return -1;
+    }
+    u.u_ar0[EAX] = 0;
+    return 0;
+}
+
+/*
+ * sys_readahead - Start reading part of a file (syscall #295)
+ *
+ * readahead(fd, offset, count).  Returns at once; at most
+ * NWILLNEED blocks are read, so one call cannot flush the
+ * whole cache.
+ */
+int sys_readahead(void) {
+    struct file *fp;
+    struct inode *ip;
+    daddr_t lbn;
+    int n;
+    
+    fp = getf(u.u_arg[0]);
+    if (fp == NULL) {
+        return -1;
+    }
+    if ((fp->f_flag & FREAD) == 0) {
+        u.u_error = EBADF;
+        return -1;
+    }
+    ip = fp->f_inode;
+    if ((fp->f_flag & FPIPE) || (ip->i_mode & IFMT) == IFCHR ||
+        (ip->i_mode & IFMT) == IFDIR) {
+        u.u_error = EINVAL;
+        return -1;
+    }
+    n = fadvrange(ip, u.u_arg[1], u.u_arg[2], &lbn);
+    if (n < 0) {
+        return -1;
+    }
+    rahead(ip, lbn, n < NWILLNEED ? n : NWILLNEED);
+    u.u_ar0[EAX] = 0;
+    return 0;
 }
 
 int sys_openat(void) {
@@ -3747,7 +4913,7 @@ int sys_getrusage(void) {
     ru.ru_utime[1] = u.u_utime;
     ru.ru_stime[0] = 0;
     ru.ru_stime[1] = u.u_stime;
-    ru.ru_maxrss = u.u_procp->p_size;
+    ru.ru_maxrss = u.u_procp->p_size + u.u_ssize;
     ru.ru_ixrss = 0;
     ru.ru_idrss = 0;
     ru.ru_isrss = 0;
@@ -3770,6 +4936,17 @@ int sys_getrusage(void) {
     return 0;
 }
 
+/*
+ * sys_memstat - Get core allocator statistics (syscall #33)
+ */
+int sys_memstat(void) {
+    if (copyout((caddr_t)&corestat, (caddr_t)u.u_arg[0], sizeof(corestat)) < 0) {
+        u.u_error = EFAULT;
+        return -1;
+    }
+    return 0;
+}
+
 /*
  * sys_chown2 - Change file owner (syscall #94)
  */
@@ -63,10 +63,14 @@ int sys_enosys(void);
 int truncate(void);
 int ftruncate(void);
 int fsync(void);
+int sys_fdatasync(void);
 int utime(void);
 int sys_pipe(void);
 int sys_dup(void);
 int sys_dup2(void);
+int sys_vfork(void);
+int sys_spawn(void);
+int sys_memstat(void);
 int sys_stat(void);
 int sys_fstat(void);
 int sys_lstat(void);
@@ -134,10 +138,14 @@ int sys_shmctl(void);
 int sys_shmat(void);
 int sys_shmdt(void);
 int sys_copy_file_range(void);
+int sys_sendfile(void);
+int sys_splice(void);
+int sys_tee(void);
 int sys_epoll_create1(void);
 int sys_epoll_ctl(void);
 int sys_epoll_pwait(void);
 int sys_getdents(void);
+int sys_readdirplus(void);
 int sys_getitimer(void);
 int sys_rt_sigprocmask(void);
 int sys_set_tid_address(void);
@@ -150,6 +158,15 @@ int sys_rt_sigaction(void);
 int sys_tkill(void);
 int sys_exit_group(void);
 int sys_fadvise(void);
+int sys_readahead(void);
+int sys_pread(void);
+int sys_pread64(void);
+int sys_preadv(void);
+int sys_pwrite(void);
+int sys_pwrite64(void);
+int sys_pwritev(void);
+int sys_readv(void);
+int sys_writev(void);
 int sys_openat(void);
 int sys_getrandom(void);
 int sys_inotify_init1(void);
@@ -210,20 +227,20 @@ struct sysent sysent[] = {
     { 0, getuid },          /* 24 = getuid */
     { 0, stime },           /* 25 = stime */
     { 3, ptrace },          /* 26 = ptrace */
-    { 0, nosys },           /* 27 = x */
+    { 0, sys_vfork },       /* 27 = vfork */
     { 1, fstat },           /* 28 = fstat */
-    { 0, nosys },           /* 29 = x */
+    { 4, sys_spawn },       /* 29 = spawn */
     { 1, nullsys },         /* 30 = smdate (inoperative) */
     { 1, stty },            /* 31 = stty */
     { 1, gtty },            /* 32 = gtty */
-    { 0, nosys },           /* 33 = x */
+    { 1, sys_memstat },     /* 33 = memstat */
     { 0, nice },            /* 34 = nice */
     { 0, sslep },           /* 35 = sleep */
     { 0, sync },            /* 36 = sync */
     { 1, kill },            /* 37 = kill */
     { 0, getswit },         /* 38 = switch */
     { 1, getfbinfo },       /* 39 = getfbinfo */
-    { 0, nosys },           /* 40 = x */
+    { 3, sys_readdirplus }, /* 40 = readdirplus */
     { 0, dup },             /* 41 = dup */
     { 0, syspipe },         /* 42 = pipe */
     { 1, times },           /* 43 = times */
@@ -307,11 +324,11 @@ struct sysent sysent[] = {
     { 3, sys_shmctl },     /* 121 = shmctl (stub) */
     { 3, sys_shmat },      /* 122 = shmat (stub) */
     { 1, sys_ok },         /* 123 = shmdt (no-op) */
-    { 6, sys_copy_file_range }, /* 124 = copy_file_range (stub) */
+    { 6, sys_copy_file_range }, /* 124 = copy_file_range */
     { 1, sys_epoll_create1 },   /* 125 = epoll_create1 (stub) */
     { 4, sys_epoll_ctl },       /* 126 = epoll_ctl (stub) */
     { 6, sys_epoll_pwait },     /* 127 = epoll_pwait (stub) */
-    { 3, sys_getdents },        /* 128 = getdents (stub) */
+    { 3, sys_getdents },        /* 128 = getdents */
     { 2, sys_getitimer },       /* 129 = getitimer (stub) */
     { 4, sys_rt_sigprocmask },  /* 130 = rt_sigprocmask (stub) */
     { 1, sys_set_tid_address }, /* 131 = set_tid_address (stub) */
@@ -319,11 +336,11 @@ struct sysent sysent[] = {
     { 2, sys_flock },           /* 133 = flock (stub) */
     { 2, sys_fanotify_init },   /* 134 = fanotify_init (stub) */
     { 6, sys_fanotify_mark },   /* 135 = fanotify_mark (stub) */
-    { 6, sys_fallocate },       /* 136 = fallocate (stub) */
+    { 4, sys_fallocate },       /* 136 = fallocate */
     { 4, sys_rt_sigaction },    /* 137 = rt_sigaction (stub) */
     { 2, sys_tkill },           /* 138 = tkill (stub) */
     { 1, sys_exit_group },      /* 139 = exit_group (stub) */
-    { 6, sys_fadvise },         /* 140 = fadvise (stub) */
+    { 4, sys_fadvise },         /* 140 = fadvise */
     { 4, sys_openat },          /* 141 = openat (stub) */
     { 3, sys_getrandom },       /* 142 = getrandom (stub) */
     { 1, sys_inotify_init1 },   /* 143 = inotify_init1 (stub) */
@@ -390,7 +407,7 @@ struct sysent sysent[] = {
     { 0, sys_enosys },     /* 204 = fchown32 */
     { 0, sys_enosys },     /* 205 = fchownat */
     { 0, sys_enosys },     /* 206 = fcntl64 */
-    { 0, sys_enosys },     /* 207 = fdatasync */
+    { 1, sys_fdatasync },  /* 207 = fdatasync */
     { 0, sys_enosys },     /* 208 = fgetxattr */
     { 0, sys_enosys },     /* 209 = flistxattr */
     { 0, sys_enosys },     /* 210 = fremovexattr */
@@ -400,7 +417,7 @@ struct sysent sysent[] = {
     { 0, sys_enosys },     /* 214 = fstatat64 */
     { 0, sys_enosys },     /* 215 = fstatfs */
     { 0, sys_enosys },     /* 216 = fstatfs64 */
-    { 0, sys_enosys },     /* 217 = fsync */
+    { 1, fsync },          /* 217 = fsync */
     { 0, sys_enosys },     /* 218 = ftruncate */
     { 0, sys_enosys },     /* 219 = ftruncate64 */
     { 0, sys_enosys },     /* 220 = futex */
@@ -464,24 +481,24 @@ struct sysent sysent[] = {
     { 0, sys_enosys },     /* 278 = ppoll */
     { 0, sys_enosys },     /* 279 = ppoll_time64 */
     { 0, sys_enosys },     /* 280 = prctl */
-    { 0, sys_enosys },     /* 281 = pread */
-    { 0, sys_enosys },     /* 282 = pread64 */
-    { 0, sys_enosys },     /* 283 = preadv */
+    { 4, sys_pread },      /* 281 = pread */
+    { 5, sys_pread64 },    /* 282 = pread64 */
+    { 4, sys_preadv },     /* 283 = preadv */
     { 0, sys_enosys },     /* 284 = preadv2 */
     { 0, sys_enosys },     /* 285 = prlimit64 */
     { 0, sys_enosys },     /* 286 = process_vm_readv */
     { 0, sys_enosys },     /* 287 = process_vm_writev */
     { 0, sys_enosys },     /* 288 = pselect6 */
     { 0, sys_enosys },     /* 289 = pselect6_time64 */
-    { 0, sys_enosys },     /* 290 = pwrite */
-    { 0, sys_enosys },     /* 291 = pwrite64 */
-    { 0, sys_enosys },     /* 292 = pwritev */
+    { 4, sys_pwrite },     /* 290 = pwrite */
+    { 5, sys_pwrite64 },   /* 291 = pwrite64 */
+    { 4, sys_pwritev },    /* 292 = pwritev */
     { 0, sys_enosys },     /* 293 = pwritev2 */
     { 0, sys_enosys },     /* 294 = quotactl */
-    { 0, sys_enosys },     /* 295 = readahead */
+    { 3, sys_readahead },  /* 295 = readahead */
     { 0, sys_enosys },     /* 296 = readlink */
     { 0, sys_enosys },     /* 297 = readlinkat */
-    { 0, sys_enosys },     /* 298 = readv */
+    { 3, sys_readv },      /* 298 = readv */
     { 0, sys_enosys },     /* 299 = reboot */
     { 0, sys_enosys },     /* 300 = recvmmsg */
     { 0, sys_enosys },     /* 301 = recvmmsg_time64 */
@@ -506,7 +523,7 @@ struct sysent sysent[] = {
     { 0, sys_enosys },     /* 320 = sched_yield */
     { 0, sys_enosys },     /* 321 = semtimedop */
     { 0, sys_enosys },     /* 322 = semtimedop_time64 */
-    { 0, sys_enosys },     /* 323 = sendfile */
+    { 4, sys_sendfile },   /* 323 = sendfile */
     { 0, sys_enosys },     /* 324 = sendfile64 */
     { 0, sys_enosys },     /* 325 = sendmmsg */
     { 0, sys_enosys },     /* 326 = set_robust_list */
@@ -538,7 +555,7 @@ struct sysent sysent[] = {
     { 0, sys_enosys },     /* 352 = signalfd */
     { 0, sys_enosys },     /* 353 = signalfd4 */
     { 0, sys_enosys },     /* 354 = socketcall */
-    { 0, sys_enosys },     /* 355 = splice */
+    { 6, sys_splice },     /* 355 = splice */
     { 0, sys_enosys },     /* 356 = stat64 */
     { 0, sys_enosys },     /* 357 = statfs */
     { 0, sys_enosys },     /* 358 = statfs64 */
@@ -551,7 +568,7 @@ struct sysent sysent[] = {
     { 0, sys_enosys },     /* 365 = sync_file_range2 */
     { 0, sys_enosys },     /* 366 = syncfs */
     { 0, sys_enosys },     /* 367 = sysinfo */
-    { 0, sys_enosys },     /* 368 = tee */
+    { 4, sys_tee },        /* 368 = tee */
     { 0, sys_enosys },     /* 369 = timer_create */
     { 0, sys_enosys },     /* 370 = timer_delete */
     { 0, sys_enosys },     /* 371 = timer_getoverrun */
@@ -581,7 +598,7 @@ struct sysent sysent[] = {
     { 0, sys_enosys },     /* 395 = vmsplice */
     { 0, sys_enosys },     /* 396 = wait4 */
     { 0, sys_enosys },     /* 397 = wait4_time64 */
-    { 0, sys_enosys },     /* 398 = writev */
+    { 3, sys_writev },     /* 398 = writev */
     { 0, sys_enosys },     /* 399 = socketcall */
     { 0, sys_enosys },     /* 400 = socket */
     { 0, sys_enosys },     /* 401 = bind */
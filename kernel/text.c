@@ -2,7 +2,9 @@
  * Unix V6 x86 Port
  * Ported from original V6 ken/text.c
  *
- * Manages shared text (code) segments for processes
+ * Manages shared text (code) segments for processes.
+ * A text holds the pages of a loaded executable, which its
+ * users map copy-on-write (see xalloc).
  */
 
 #include "include/types.h"
@@ -10,71 +12,227 @@
 #include "include/proc.h"
 #include "include/inode.h"
 #include "include/text.h"
+#include "include/user.h"
+#include "include/systm.h"
+#include "include/vm.h"
 
-extern void kprintf(const char *fmt, ...);
-extern void sleep(void *chan, int pri);
-extern void wakeup(void *chan);
 extern void iput(struct inode *ip);
+extern void readi(struct inode *ip);
 
 /* Text table */
 struct text text[NTEXT];
 
 /*
- * xalloc - Allocate text segment for a process
+ * xpgfree - Free the pages holding a text's image
+ */
+static void xpgfree(struct text *xp) {
+    pte_t *pl;
+    int i;
+
+    if (xp->x_caddr) {
+        pl = (pte_t *)xp->x_caddr;
+        for (i = 0; i < NPTE && pl[i]; i++) {
+            pgfree(pl[i]);
+        }
+        pgfree(xp->x_caddr);
+        xp->x_caddr = 0;
+    }
+}
+
+/*
+ * xrelse - Free the pages of a text no one is running and
+ * give up its inode.  If the inode is locked (by our caller
+ * in open or exec, or by someone in readi) the reference is
+ * only dropped: iput would unlock it under its holder.
+ */
+static void xrelse(struct text *xp) {
+    struct inode *ip;
+
+    xpgfree(xp);
+    ip = xp->x_iptr;
+    ip->i_flag &= ~ITEXT;
+    xp->x_iptr = NULL;
+    xp->x_flag = 0;
+    if (ip->i_flag & ILOCK) {
+        ip->i_count--;
+    } else {
+        iput(ip);
+    }
+}
+
+/*
+ * xalloc - Attach the image of executable ip, size bytes
+ * starting at offset off in the file, to the current process
+ *
+ * The first user reads the file into pages kept by the
+ * text; every user, the first included, maps those pages
+ * read-only and copy-on-write from user address 0, so code
+ * stays shared and only pages that are stored into (data)
+ * get copied.  Later execs read nothing.
  *
- * ip - inode of executable file
- * Returns text structure pointer or NULL on failure
+ * Returns the text structure, or NULL if the image cannot
+ * be shared (too big, table full, or core short); the
+ * caller then reads the file itself.
  */
-struct text *xalloc(struct inode *ip) {
+struct text *xalloc(struct inode *ip, uint32_t off, uint32_t size) {
     struct text *xp, *xp1;
-    
+    struct proc *p;
+    pte_t *pl;
+    uint32_t pa;
+    int i, n;
+
+    n = pground(size) >> PGSHIFT;
+    if (n == 0 || n >= NPTE) {
+        return NULL;
+    }
+
     /* First, look for an existing copy of this text */
     xp1 = NULL;
     for (xp = &text[0]; xp < &text[NTEXT]; xp++) {
         if (xp->x_iptr == NULL) {
             if (xp1 == NULL) xp1 = xp;  /* Remember first free */
         } else if (xp->x_iptr == ip) {
-            /* Found existing text segment */
+            /* Found existing text segment; wait until it is loaded */
             xp->x_count++;
-            return xp;
+            xlock(xp);
+            if (xp->x_caddr == 0 && xp->x_count == 1) {
+                /* Sticky, but its pages were taken back (see xflush) */
+                goto load;
+            }
+            goto found;
         }
     }
-    
+
     /* No existing copy - allocate new slot */
     if (xp1 == NULL) {
         kprintf("text table overflow\n");
         return NULL;
     }
-    
+
     xp = xp1;
     xp->x_count = 1;
     xp->x_iptr = ip;
     xp->x_ccount = 0;
-    xp->x_caddr = 0;  /* Would allocate memory here */
-    xp->x_size = 0;   /* Would get size from exec header */
-    
+    xp->x_flag = XLOCK;
+    xp->x_size = (size + 63) >> 6;
+    if (ip->i_mode & ISVTX) {
+        xp->x_flag |= XSTICK;
+    }
+
     ip->i_flag |= ITEXT;
     ip->i_count++;
-    
+
+load:
+    /* Read the image into a page at a time; the list ends at a 0 entry */
+    if ((xp->x_caddr = pgalloc()) == 0) {
+        goto found;
+    }
+    pl = (pte_t *)xp->x_caddr;
+    u.u_segflg = 1;
+    for (i = 0; i < n; i++) {
+        if ((pa = pgalloc()) == 0) {
+            break;
+        }
+        pl[i] = pa;
+        u.u_base = (caddr_t)pa;
+        u.u_count = (i == n - 1) ? size - i * PGSIZE : PGSIZE;
+        u.u_offset[0] = 0;
+        u.u_offset[1] = off + i * PGSIZE;
+        readi(ip);
+        if (u.u_error) {
+            break;
+        }
+    }
+    u.u_segflg = 0;
+    if (i < n) {
+        xpgfree(xp);
+    }
+
+found:
+    if (xp->x_caddr == 0) {
+        xp->x_flag &= ~XSTICK;
+        xunlock(xp);
+        xfree(xp);
+        return NULL;
+    }
+    p = u.u_procp;
+    pl = (pte_t *)xp->x_caddr;
+    for (i = 0; i < n; i++) {
+        if (vmshare(p->p_cr3, i * PGSIZE, pl[i]) < 0) {
+            vmunmap(p->p_cr3, 0, i * PGSIZE);
+            xunlock(xp);
+            xfree(xp);
+            return NULL;
+        }
+    }
+    p->p_size = USIZE + n * PGCLICK;
+    xunlock(xp);
     return xp;
 }
 
 /*
  * xfree - Free a text segment reference
+ * The last one releases the text, unless it is sticky
+ * (ISVTX): then it stays loaded for the next exec until
+ * core runs short or the file is written.
  */
 void xfree(struct text *xp) {
     if (xp == NULL) return;
-    
-    if (--xp->x_count == 0) {
-        /* Last reference */
-        if (xp->x_iptr) {
-            xp->x_iptr->i_flag &= ~ITEXT;
-            iput(xp->x_iptr);
-            xp->x_iptr = NULL;
+
+    if (--xp->x_count == 0 && (xp->x_flag & XSTICK) == 0) {
+        xrelse(xp);
+    }
+}
+
+/*
+ * xrele - Drop the sticky text of ip if no one is running
+ * it, so that the file may be written
+ */
+void xrele(struct inode *ip) {
+    struct text *xp;
+
+    if ((ip->i_flag & ITEXT) == 0) {
+        return;
+    }
+    for (xp = &text[0]; xp < &text[NTEXT]; xp++) {
+        if (xp->x_iptr == ip && xp->x_count == 0) {
+            xrelse(xp);
+        }
+    }
+}
+
+/*
+ * xflush - Free the pages of every sticky text no one is
+ * running, for a page allocation that has come up short.
+ * The texts keep their inodes, as iput may not be called
+ * from inside pgalloc; the next exec reloads the pages.
+ * Returns the number flushed.
+ */
+int xflush(void) {
+    struct text *xp;
+    int n;
+
+    n = 0;
+    for (xp = &text[0]; xp < &text[NTEXT]; xp++) {
+        if (xp->x_caddr && xp->x_count == 0 && (xp->x_flag & XLOCK) == 0) {
+            xpgfree(xp);
+            n++;
+        }
+    }
+    return n;
+}
+
+/*
+ * xumount - Drop every text on device dev that no one is
+ * running, so that its sticky texts do not keep it busy
+ */
+void xumount(dev_t dev) {
+    struct text *xp;
+
+    for (xp = &text[0]; xp < &text[NTEXT]; xp++) {
+        if (xp->x_iptr && xp->x_iptr->i_dev == dev && xp->x_count == 0) {
+            xrelse(xp);
         }
-        
-        /* Would free memory here */
-        xp->x_caddr = 0;
     }
 }
 
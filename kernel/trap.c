@@ -12,6 +12,7 @@
 #include "include/proc.h"
 #include "include/systm.h"
 #include "include/reg.h"
+#include "include/vm.h"
 
 /* External declarations */
 extern struct proc proc[];
@@ -78,7 +79,7 @@ void trap(uint32_t *frame) {
     
     /* Debug print for traps: avoid IRQ/0x80 spam */
     trapno = frame[TRAPNO];
-    if (trapno != 0x80 && !(trapno >= 32 && trapno < 48)) {
+    if (trapno != 0x80 && trapno != 14 && !(trapno >= 32 && trapno < 48)) {
         kprintf("TRAP: %d EIP=%x CS=%x\n", trapno, frame[EIP], frame[CS]);
     }
     uint32_t cs;
@@ -246,9 +247,19 @@ void trap(uint32_t *frame) {
      */
     case 14:
         if (from_user) {
+            /* A store to a copy-on-write page gets its own copy */
+            if ((err & 3) == 3 &&
+                vmcow(u.u_procp->p_cr3, rcr2() - USERBASE) == 0) {
+                break;
+            }
+            /* A reference below the stack grows it */
+            if ((err & 1) == 0 && grow(rcr2() - USERBASE)) {
+                break;
+            }
             sig = SIGSEG;
             goto signal;
         }
+        kprintf("page fault at %x\n", rcr2());
         goto kernel_fault;
     
     /*
@@ -331,6 +342,7 @@ void trap(uint32_t *frame) {
         
         /* Call the system call handler */
         trap1(callp->call);
+        u.u_iovcnt = 0;     /* Even if a signal cut a readv or writev short */
         /* kprintf("trap: syscall returned\n"); */
         
         /* Handle errors */
@@ -25,6 +25,7 @@ extern void kprintf(const char *fmt, ...);
 extern void sleep(void *chan, int pri);
 extern void wakeup(void *chan);
 extern int fuword(caddr_t addr);
+extern int cpass(void);
 extern int subyte(caddr_t addr, int c);
 extern int suword(caddr_t addr, int val);
 extern void signal(void *tp, int sig);
@@ -366,14 +367,11 @@ void ttwrite(struct tty *tp) {
     }
     
     while (u.u_count) {
-        /* Get character from user */
-        extern int fubyte(caddr_t addr);
-        c = fubyte(u.u_base++);
+        /* Get character from user, or from the kernel for splice */
+        c = cpass();
         if (c < 0) {
-            u.u_error = EFAULT;
             return;
         }
-        u.u_count--;
         
         ttyoutput(c, tp);
     }
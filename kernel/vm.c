@@ -0,0 +1,654 @@
+/* vm.c - Paged Memory Management
+ * Unix V6 x86 Port
+ *
+ * Each process has its own page directory, named by p_cr3.
+ * User pages come from coremap in page-sized units, so an
+ * image need not be contiguous in core and grows or shrinks
+ * by mapping or unmapping pages at its end.  Pages may be
+ * mapped by several processes after a fork; pgref counts
+ * the mappings of each.
+ */
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/systm.h"
+#include "include/user.h"
+#include "include/proc.h"
+#include "include/buf.h"
+#include "include/text.h"
+#include "include/multiboot.h"
+#include "include/vm.h"
+
+extern uint32_t maxmem;
+extern void swap(daddr_t blkno, caddr_t addr, int count, int rdflg);
+
+/* Page directory of process 0, and the kernel map every process shares */
+pte_t kpgdir[NPTE] __attribute__((aligned(PGSIZE)));
+
+/* Number of mappings of each page of core; NPROC fits in a byte */
+static uint8_t pgref[MAXMEM / PGCLICK];
+
+/*
+ * vminit - Map the kernel and turn on paging
+ *
+ * Core up to maxmem and the frame buffer are mapped 1:1 with
+ * 4MB pages, so kernel addresses and physical addresses stay
+ * the same and no kernel page tables are needed.
+ */
+void vminit(void) {
+    uint32_t a, n;
+
+    n = (maxmem * 64 + PDSIZE - 1) >> PDSHIFT;
+    for (a = 0; a < n; a++) {
+        kpgdir[a] = (a << PDSHIFT) | PG_PS | PG_W | PG_P;
+    }
+
+    if (fb_addr) {
+        a = (uint32_t)fb_addr & ~(PDSIZE - 1);
+        n = ((uint32_t)fb_addr - a + fb_pitch * fb_height + PDSIZE - 1) >> PDSHIFT;
+        if (PDX(a) < PDX(USERBASE + USERSIZE) && PDX(a) + n > PDX(USERBASE)) {
+            kprintf("fb: %x lies in user space, disabled\n", (uint32_t)fb_addr);
+            fb_addr = 0;
+        } else {
+            while (n--) {
+                kpgdir[PDX(a)] = a | PG_PS | PG_W | PG_P;
+                a += PDSIZE;
+            }
+        }
+    }
+
+    /* CR4.PSE, then CR0.PG with CR0.WP so the kernel honours read-only pages */
+    __asm__ __volatile__(
+        "movl %%cr4, %%eax\n\t"
+        "orl $0x10, %%eax\n\t"
+        "movl %%eax, %%cr4\n\t"
+        "movl %0, %%cr3\n\t"
+        "movl %%cr0, %%eax\n\t"
+        "orl $0x80010000, %%eax\n\t"
+        "movl %%eax, %%cr0"
+        : : "r"(kpgdir) : "eax", "memory");
+
+    kprintf("paging: %d MB mapped, user space at %x\n",
+           (maxmem * 64) >> 20, USERBASE);
+}
+
+/*
+ * lcr3 - Switch to a page directory
+ */
+void lcr3(uint32_t pd) {
+    __asm__ __volatile__("movl %0, %%cr3" : : "r"(pd) : "memory");
+}
+
+static uint32_t rcr3(void) {
+    uint32_t pd;
+
+    __asm__ __volatile__("movl %%cr3, %0" : "=r"(pd));
+    return pd;
+}
+
+/*
+ * rcr2 - Linear address of the last page fault
+ */
+uint32_t rcr2(void) {
+    uint32_t la;
+
+    __asm__ __volatile__("movl %%cr2, %0" : "=r"(la));
+    return la;
+}
+
+/*
+ * pgalloc - Take a zeroed page from coremap
+ * Returns its physical address, 0 if core is exhausted.
+ * Everything in coremap is allocated in whole pages, so a
+ * page-aligned map stays page-aligned.
+ */
+uint32_t pgalloc(void) {
+    uint32_t a;
+
+    a = malloc(coremap, PGCLICK);
+    if (a == 0 && vmreclaim()) {
+        a = malloc(coremap, PGCLICK);
+    }
+    if (a == 0) {
+        return 0;
+    }
+    clearsegs(a, PGCLICK);
+    a *= 64;
+    pgref[a >> PGSHIFT] = 1;
+    return a;
+}
+
+/*
+ * pgfree - Drop a reference to a page, returning it to
+ * coremap when the last one goes
+ */
+void pgfree(uint32_t pa) {
+    if (--pgref[pa >> PGSHIFT] == 0) {
+        mfree(coremap, PGCLICK, pa / 64);
+    }
+}
+
+/*
+ * vmpte - Find the entry mapping user address va in
+ * directory pd, allocating the page table if alloc is set.
+ */
+static pte_t *vmpte(uint32_t pd, uint32_t va, int alloc) {
+    pte_t *pdp;
+    uint32_t pt;
+
+    if (va >= USERSIZE) {
+        return NULL;
+    }
+    pdp = (pte_t *)pd + PDX(USERBASE + va);
+    if ((*pdp & PG_P) == 0) {
+        if (!alloc || (pt = pgalloc()) == 0) {
+            return NULL;
+        }
+        *pdp = pt | PG_U | PG_W | PG_P;
+    }
+    return (pte_t *)(*pdp & PG_FRAME) + PTX(USERBASE + va);
+}
+
+/*
+ * vtop - Physical address behind user address va, 0 if unmapped
+ */
+uint32_t vtop(uint32_t pd, uint32_t va) {
+    pte_t *pte;
+
+    pte = vmpte(pd, va, 0);
+    if (pte == NULL || (*pte & PG_P) == 0) {
+        return 0;
+    }
+    return (*pte & PG_FRAME) | (va & (PGSIZE - 1));
+}
+
+/*
+ * pgrun - Take a run of up to *np zeroed pages, starting at
+ * physical address want if that extent is free, so that a
+ * growing image stays contiguous in core.  The run is cut
+ * down until it fits; *np is set to its length.
+ * Returns its physical address, 0 if core is exhausted.
+ */
+static uint32_t pgrun(uint32_t want, int *np) {
+    uint32_t a;
+    int n, i;
+
+    for (n = *np; n > 0; n >>= 1) {
+        if (want && mgrow(coremap, want / 64, n * PGCLICK)) {
+            a = want / 64;
+            break;
+        }
+        if ((a = malloc(coremap, n * PGCLICK)) != 0) {
+            break;
+        }
+    }
+    if (n == 0) {
+        if (!vmreclaim() || (a = malloc(coremap, PGCLICK)) == 0) {
+            return 0;
+        }
+        n = 1;
+    }
+    clearsegs(a, n * PGCLICK);
+    a *= 64;
+    for (i = 0; i < n; i++) {
+        pgref[(a >> PGSHIFT) + i] = 1;
+    }
+    *np = n;
+    return a;
+}
+
+/*
+ * vmmap - Back user addresses va..eva with zeroed pages
+ * Pages already present are left alone.  The rest are taken
+ * from coremap a run at a time, following the page before
+ * va where possible, so growing by n pages costs one map
+ * search rather than n.  Returns -1 when core runs out; the
+ * caller unmaps the range.
+ */
+int vmmap(uint32_t pd, uint32_t va, uint32_t eva) {
+    pte_t *pte;
+    uint32_t pa, prev;
+    int n, r;
+
+    va &= PG_FRAME;
+    prev = va ? vtop(pd, va - PGSIZE) : 0;
+    pa = 0;
+    n = 0;
+    r = 0;
+    for (; va < eva; va += PGSIZE) {
+        if ((pte = vmpte(pd, va, 1)) == NULL) {
+            r = -1;
+            break;
+        }
+        if (*pte & PG_P) {
+            prev = *pte & PG_FRAME;
+            continue;
+        }
+        if (n == 0) {
+            n = (pground(eva) - va) >> PGSHIFT;
+            if ((pa = pgrun(prev ? prev + PGSIZE : 0, &n)) == 0) {
+                r = -1;
+                break;
+            }
+        }
+        *pte = pa | PG_U | PG_W | PG_P;
+        prev = pa;
+        pa += PGSIZE;
+        n--;
+    }
+    /* Pages of the run not needed after all */
+    for (; n > 0; n--, pa += PGSIZE) {
+        pgfree(pa);
+    }
+    return r;
+}
+
+/*
+ * vmunmap - Release the pages behind user addresses va..eva
+ * Page tables are kept until the directory is freed.
+ */
+void vmunmap(uint32_t pd, uint32_t va, uint32_t eva) {
+    pte_t *pte;
+
+    for (va &= PG_FRAME; va < eva; va += PGSIZE) {
+        pte = vmpte(pd, va, 0);
+        if (pte == NULL || (*pte & PG_P) == 0) {
+            continue;
+        }
+        pgfree(*pte & PG_FRAME);
+        *pte = 0;
+    }
+    if (pd == rcr3()) {
+        lcr3(pd);
+    }
+}
+
+/*
+ * vmcow - Give the process behind pd its own copy of the
+ * copy-on-write page holding user address va, and make it
+ * writable.  The last sharer keeps the page without copying.
+ * Returns -1 if the page may not be written or core runs out.
+ */
+int vmcow(uint32_t pd, uint32_t va) {
+    pte_t *pte;
+    uint32_t pa, npa;
+
+    pte = vmpte(pd, va, 0);
+    if (pte == NULL || (*pte & PG_P) == 0) {
+        return -1;
+    }
+    if (*pte & PG_W) {
+        return 0;
+    }
+    if ((*pte & PG_COW) == 0) {
+        return -1;
+    }
+    pa = *pte & PG_FRAME;
+    if (pgref[pa >> PGSHIFT] > 1) {
+        if ((npa = pgalloc()) == 0) {
+            return -1;
+        }
+        copysegs(pa / 64, npa / 64, PGCLICK);
+        pgfree(pa);
+        pa = npa;
+    }
+    *pte = pa | (*pte & ~(PG_FRAME | PG_COW)) | PG_W;
+    if (pd == rcr3()) {
+        __asm__ __volatile__("invlpg (%0)" : : "r"(USERBASE + va) : "memory");
+    }
+    return 0;
+}
+
+/*
+ * vmshare - Map page pa at user address va of pd read-only
+ * and copy-on-write, taking a reference to it.  This is how
+ * a shared text reaches its users.  Returns -1 if core runs out.
+ */
+int vmshare(uint32_t pd, uint32_t va, uint32_t pa) {
+    pte_t *pte;
+
+    if ((pte = vmpte(pd, va, 1)) == NULL) {
+        return -1;
+    }
+    if (*pte & PG_P) {
+        pgfree(*pte & PG_FRAME);
+    }
+    *pte = pa | PG_U | PG_COW | PG_P;
+    pgref[pa >> PGSHIFT]++;
+    return 0;
+}
+
+/*
+ * vmdup - Make a new page directory holding the kernel map
+ * and the user pages mapped by pd.  The pages are shared;
+ * writable ones become read-only and copy-on-write in both
+ * directories, to be split by vmcow on the first store.
+ * Returns its physical address, 0 if core runs out.
+ */
+uint32_t vmdup(uint32_t pd) {
+    uint32_t npd, va;
+    pte_t *pt, *pte;
+    int i, j;
+
+    if ((npd = pgalloc()) == 0) {
+        return 0;
+    }
+    copysegs((uint32_t)kpgdir / 64, npd / 64, PGCLICK);
+
+    for (i = PDX(USERBASE); i < (int)PDX(USERBASE + USERSIZE); i++) {
+        if ((((pte_t *)pd)[i] & PG_P) == 0) {
+            continue;
+        }
+        pt = (pte_t *)(((pte_t *)pd)[i] & PG_FRAME);
+        for (j = 0; j < NPTE; j++) {
+            if ((pt[j] & PG_P) == 0) {
+                continue;
+            }
+            va = ((i << PDSHIFT) | (j << PGSHIFT)) - USERBASE;
+            if ((pte = vmpte(npd, va, 1)) == NULL) {
+                goto bad;
+            }
+            if (pt[j] & PG_W) {
+                pt[j] = (pt[j] & ~PG_W) | PG_COW;
+            }
+            *pte = pt[j];
+            pgref[pt[j] >> PGSHIFT]++;
+        }
+    }
+    if (pd == rcr3()) {
+        lcr3(pd);
+    }
+    return npd;
+
+bad:
+    if (pd == rcr3()) {
+        lcr3(pd);
+    }
+    vmfree(npd);
+    return 0;
+}
+
+/*
+ * vmfree - Release a page directory with its page tables
+ * and every user page it maps
+ */
+void vmfree(uint32_t pd) {
+    pte_t *pt;
+    int i, j;
+
+    if (pd == 0 || pd == (uint32_t)kpgdir) {
+        return;
+    }
+    for (i = PDX(USERBASE); i < (int)PDX(USERBASE + USERSIZE); i++) {
+        if ((((pte_t *)pd)[i] & PG_P) == 0) {
+            continue;
+        }
+        pt = (pte_t *)(((pte_t *)pd)[i] & PG_FRAME);
+        for (j = 0; j < NPTE; j++) {
+            if (pt[j] & PG_P) {
+                pgfree(pt[j] & PG_FRAME);
+            }
+        }
+        pgfree((uint32_t)pt);
+    }
+    pgfree(pd);
+}
+
+/*
+ * vmreclaim - Take back core that other processes hold but
+ * do not use, when an allocation has failed: the images of
+ * zombies, heap reserved past the break (see growbrk) and
+ * sticky texts.  Images in core are paged, so nothing needs
+ * to be moved.  Failing that, an idle process is swapped out.
+ * Returns the number of pages freed.
+ */
+int vmreclaim(void) {
+    struct proc *p, *q;
+    uint32_t n, f;
+
+    f = corestat.ms_free;
+    for (p = &proc[0]; p < &proc[NPROC]; p++) {
+        if (p == u.u_procp || (p->p_flag & (SLOAD | SVFORK)) != SLOAD ||
+            p->p_stat == SNULL || p->p_addr == 0) {
+            continue;
+        }
+        if (p->p_stat == SZOMB) {
+            mfree(coremap, USIZE, p->p_addr);
+            vmfree(p->p_cr3);
+            p->p_addr = 0;
+            p->p_cr3 = 0;
+            p->p_size = 0;
+            continue;
+        }
+        /* A vfork child may be using the heap */
+        for (q = &proc[0]; q < &proc[NPROC]; q++) {
+            if ((q->p_flag & SVFORK) && q->p_cr3 == p->p_cr3) {
+                break;
+            }
+        }
+        if (q < &proc[NPROC]) {
+            continue;
+        }
+        n = p->p_brk;
+        if (n && n < p->p_size) {
+            vmunmap(p->p_cr3, pground((n - USIZE) * 64), (p->p_size - USIZE) * 64);
+            p->p_size = n;
+        }
+    }
+
+    /* Sticky texts no one is running */
+    if (corestat.ms_free == f) {
+        xflush();
+    }
+
+    /*
+     * Still short: swap out the process that has waited
+     * longest, preferring one asleep at low priority or
+     * stopped, as sched does.
+     */
+    if (corestat.ms_free == f) {
+        q = NULL;
+        for (p = &proc[0]; p < &proc[NPROC]; p++) {
+            if (!vmswapok(p) || p->p_stat == SRUN) {
+                continue;
+            }
+            if (q == NULL || (p->p_stat != SSLEEP && q->p_stat == SSLEEP) ||
+                ((p->p_stat == SSLEEP) == (q->p_stat == SSLEEP) &&
+                 p->p_time > q->p_time)) {
+                q = p;
+            }
+        }
+        if (q) {
+            vmswapout(q);
+        }
+    }
+    f = corestat.ms_free - f;
+    corestat.ms_nreclaim += f;
+    return f;
+}
+
+/*
+ * vmcount - Number of user page entries in pd with any of
+ * the bits in f set
+ */
+static int vmcount(uint32_t pd, uint32_t f) {
+    pte_t *pt;
+    int i, j, n;
+
+    n = 0;
+    for (i = PDX(USERBASE); i < (int)PDX(USERBASE + USERSIZE); i++) {
+        if ((((pte_t *)pd)[i] & PG_P) == 0) {
+            continue;
+        }
+        pt = (pte_t *)(((pte_t *)pd)[i] & PG_FRAME);
+        for (j = 0; j < NPTE; j++) {
+            if (pt[j] & f) {
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+/*
+ * swrun - Move n pages between core at pa and swap at blk
+ * with a single transfer
+ */
+static void swrun(uint32_t blk, uint32_t pa, int n, int rdflg) {
+    swap(blk, (caddr_t)pa, n * PGBLK, rdflg);
+    corestat.ms_nswio++;
+    if (rdflg) {
+        corestat.ms_pgin += n;
+    } else {
+        corestat.ms_pgout += n;
+    }
+}
+
+/*
+ * vmswapok - Whether p may be swapped out: in core, not the
+ * swapper or the running process, not locked, and not
+ * sharing its directory through vfork.
+ */
+int vmswapok(struct proc *p) {
+    struct proc *q;
+
+    if ((p->p_flag & (SLOAD | SSYS | SLOCK | SVFORK)) != SLOAD ||
+        p == u.u_procp || p->p_addr == 0 || nswap == 0) {
+        return 0;
+    }
+    if (p->p_stat != SRUN && p->p_stat != SSLEEP &&
+        p->p_stat != SWAIT && p->p_stat != SSTOP) {
+        return 0;
+    }
+    for (q = &proc[0]; q < &proc[NPROC]; q++) {
+        if (q != p && q->p_stat != SNULL && q->p_cr3 == p->p_cr3) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * vmswapout - Write the image of p to swapdev and free its
+ * core.  The u-area goes first, then each page in order of
+ * address into the blocks that follow; pages adjacent in
+ * core go out in one transfer.  Each entry is left naming
+ * its block, counted from swplo, with PG_P clear, and the
+ * page tables stay in core.  A shared page is written like any other and comes
+ * back as a private copy.  Returns 0 if swap space is short.
+ */
+int vmswapout(struct proc *p) {
+    pte_t *pt;
+    uint32_t pd, a, b, pa;
+    int i, j, n;
+
+    pd = p->p_cr3;
+    n = vmcount(pd, PG_P);
+    if ((a = malloc(swapmap, (n + 1) * PGBLK)) == 0) {
+        return 0;
+    }
+    swrun(a, p->p_addr * 64, 1, B_WRITE);
+    mfree(coremap, USIZE, p->p_addr);
+
+    b = a + PGBLK;
+    pa = 0;
+    n = 0;
+    for (i = PDX(USERBASE); i < (int)PDX(USERBASE + USERSIZE); i++) {
+        if ((((pte_t *)pd)[i] & PG_P) == 0) {
+            continue;
+        }
+        pt = (pte_t *)(((pte_t *)pd)[i] & PG_FRAME);
+        for (j = 0; j < NPTE; j++) {
+            if ((pt[j] & PG_P) == 0) {
+                continue;
+            }
+            if (n && (pt[j] & PG_FRAME) != pa + n * PGSIZE) {
+                swrun(b - n * PGBLK, pa, n, B_WRITE);
+                while (n--) {
+                    pgfree(pa + n * PGSIZE);
+                }
+                n = 0;
+            }
+            if (n == 0) {
+                pa = pt[j] & PG_FRAME;
+            }
+            n++;
+            pt[j] = ((b - swplo) << PGSHIFT) | (pt[j] & (PG_U | PG_W | PG_COW)) | PG_SWAP;
+            b += PGBLK;
+        }
+    }
+    if (n) {
+        swrun(b - n * PGBLK, pa, n, B_WRITE);
+        while (n--) {
+            pgfree(pa + n * PGSIZE);
+        }
+    }
+
+    p->p_addr = a;
+    p->p_flag &= ~SLOAD;
+    p->p_time = 0;
+    corestat.ms_nswout++;
+    return 1;
+}
+
+/*
+ * vmswapin - Bring the image of p back from swapdev, if
+ * there is core for all of it.  Pages are taken a run at a
+ * time as vmmap takes them; vmswapout wrote them to
+ * consecutive blocks, so each run is read in one transfer.
+ * Returns 0 if core is short.
+ */
+int vmswapin(struct proc *p) {
+    pte_t *pt;
+    uint32_t pd, a, pa, prev, rpa, rb;
+    int i, j, n, m, k, nsw;
+
+    pd = p->p_cr3;
+    nsw = n = vmcount(pd, PG_SWAP);
+    if (corestat.ms_free < (uint32_t)n + 1 || (a = malloc(coremap, USIZE)) == 0) {
+        return 0;
+    }
+    swrun(p->p_addr, a * 64, 1, B_READ);
+
+    pa = prev = rpa = rb = 0;
+    m = k = 0;
+    for (i = PDX(USERBASE); i < (int)PDX(USERBASE + USERSIZE); i++) {
+        if ((((pte_t *)pd)[i] & PG_P) == 0) {
+            continue;
+        }
+        pt = (pte_t *)(((pte_t *)pd)[i] & PG_FRAME);
+        for (j = 0; j < NPTE; j++) {
+            if ((pt[j] & PG_SWAP) == 0) {
+                continue;
+            }
+            if (m == 0) {
+                if (k) {
+                    swrun(rb, rpa, k, B_READ);
+                }
+                m = n;
+                if ((pa = pgrun(prev ? prev + PGSIZE : 0, &m)) == 0) {
+                    panic("swapin: out of core");
+                }
+                rpa = pa;
+                rb = (pt[j] >> PGSHIFT) + swplo;
+                k = 0;
+            }
+            pt[j] = pa | (pt[j] & (PG_U | PG_W | PG_COW)) | PG_P;
+            prev = pa;
+            pa += PGSIZE;
+            m--;
+            n--;
+            k++;
+        }
+    }
+    if (k) {
+        swrun(rb, rpa, k, B_READ);
+    }
+
+    mfree(swapmap, (nsw + 1) * PGBLK, p->p_addr);
+    p->p_addr = a;
+    p->p_flag |= SLOAD;
+    p->p_time = 0;
+    corestat.ms_nswin++;
+    return 1;
+}
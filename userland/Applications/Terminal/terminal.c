@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <spawn.h>
 /* V6 headers for wait macros in case stdlib doesn't have them */
 #include <sys/wait.h>
 
@@ -162,39 +164,16 @@ void execute_command(char *line) {
         return;
     }
     
-    /* Try to find command in PATH or /bin/ */
-    char full_path[BUFFER_SIZE];
-    
-    /* First check if it's an absolute path */
-    if (args[0][0] == '/') {
-        strcpy(full_path, args[0]);
-    } else {
-        /* Try /bin/ directory */
-        strcpy(full_path, "/bin/");
-        strcat(full_path, args[0]);
-    }
-    
-    int pid = fork();
-    if (pid == 0) {
-        /* Child process */
-        /* Set pgid for job control if we had it */
-        /* setpgid(0, 0); */
-        
-        execv(full_path, args);
-        
-        /* If execv returns, it failed */
-        /* Try without /bin prefix if it failed */
-        if (args[0][0] != '/') {
-             execv(args[0], args);
-        }
-        
-        printf("%s: command not found\n", args[0]);
-        exit(127);
-    } else if (pid > 0) {
+    /* Run it from /bin/, or as given if not found there */
+    pid_t pid;
+    int err = posix_spawnp(&pid, args[0], NULL, NULL, args, NULL);
+    if (err == 0) {
         int status;
         waitpid(pid, &status, 0);
+    } else if (err == ENOENT) {
+        printf("%s: command not found\n", args[0]);
     } else {
-        printf("fork failed\n");
+        printf("%s: cannot run (error %d)\n", args[0], err);
     }
 }
 
@@ -15,9 +15,11 @@ struct dirent {
 typedef struct {
     int fd;
     struct dirent entry;
-    char buf[1024];
+    char buf[4096];     /* Records from getdents */
     int buf_pos;
     int buf_len;
+    long loc;           /* Directory offset of the next entry */
+    int plus;           /* buf holds records with status */
 } DIR;
 
 /* Directory operations */
@@ -27,6 +29,12 @@ int closedir(DIR *dirp);
 void rewinddir(DIR *dirp);
 long telldir(DIR *dirp);
 void seekdir(DIR *dirp, long loc);
+int getdents(int fd, char *buf, int count);
+
+/* Entries with the status of each file, in one pass */
+struct stat;
+struct dirent *readdirplus(DIR *dirp, struct stat *st);
+int getdentsplus(int fd, char *buf, int count);
 
 /* File types for d_type */
 #define DT_UNKNOWN  0
@@ -40,6 +40,7 @@ extern int errno;
 #define EPIPE           32  /* Broken pipe */
 #define EDOM            33  /* Numerical argument out of domain */
 #define ERANGE          34  /* Numerical result out of range */
+#define ENAMETOOLONG    36  /* File name too long */
 
 /* Error handling functions */
 char *strerror(int errnum);
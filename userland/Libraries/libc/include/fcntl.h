@@ -2,6 +2,8 @@
 #ifndef _FCNTL_H
 #define _FCNTL_H
 
+#include <sys/types.h>
+
 /* File access modes for open() */
 #define O_RDONLY    0x0000  /* Open for reading only */
 #define O_WRONLY    0x0001  /* Open for writing only */
@@ -29,9 +31,32 @@
 /* File descriptor flags (F_GETFD, F_SETFD) */
 #define FD_CLOEXEC  1   /* Close on exec */
 
+/* fallocate() modes */
+#define FALLOC_FL_KEEP_SIZE   1   /* Allocate without changing the size */
+
+/* posix_fadvise() advice */
+#define POSIX_FADV_NORMAL     0   /* No particular pattern */
+#define POSIX_FADV_RANDOM     1   /* Random access, no read-ahead */
+#define POSIX_FADV_SEQUENTIAL 2   /* Sequential access, wide read-ahead */
+#define POSIX_FADV_WILLNEED   3   /* Range will be read soon */
+#define POSIX_FADV_DONTNEED   4   /* Range will not be read again */
+#define POSIX_FADV_NOREUSE    5   /* Data will be read only once */
+
+/* splice() and tee() flags, accepted as hints */
+#define SPLICE_F_MOVE     1
+#define SPLICE_F_NONBLOCK 2
+#define SPLICE_F_MORE     4
+
 /* Function declarations */
 int open(const char *pathname, int flags, ...);
 int creat(const char *pathname, int mode);
 int fcntl(int fd, int cmd, ...);
+ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+               size_t len, unsigned int flags);
+int fallocate(int fd, int mode, off_t offset, off_t len);
+int posix_fallocate(int fd, off_t offset, off_t len);
+int posix_fadvise(int fd, off_t offset, off_t len, int advice);
+ssize_t readahead(int fd, off_t offset, size_t count);
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags);
 
 #endif /* _FCNTL_H */
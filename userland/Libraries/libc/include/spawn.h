@@ -0,0 +1,40 @@
+/* spawn.h - Start a program in a new process */
+
+#ifndef _SPAWN_H
+#define _SPAWN_H
+
+#include <sys/types.h>
+
+#define SPAWN_MAXACT 8          /* File actions one spawn takes */
+
+/* A file action, laid out as the kernel reads it */
+struct spawn_action {
+    int         sa_type;
+    int         sa_fd;
+    int         sa_arg;
+    const char *sa_path;
+};
+
+typedef struct {
+    int                 nact;
+    struct spawn_action act[SPAWN_MAXACT];
+} posix_spawn_file_actions_t;
+
+typedef int posix_spawnattr_t;  /* No attributes are supported */
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa);
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa);
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd);
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa, int fd, int newfd);
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *fa, int fd,
+                                     const char *path, int oflag, mode_t mode);
+
+int posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *fa,
+                const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]);
+int posix_spawnp(pid_t *pid, const char *file, const posix_spawn_file_actions_t *fa,
+                 const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]);
+
+/* Raw system call: returns the pid, or -1 with errno set */
+int spawn(const char *path, char *const argv[], const void *acts, int nacts);
+
+#endif /* _SPAWN_H */
@@ -0,0 +1,27 @@
+/* sys/memstat.h - Core allocator statistics */
+
+#ifndef _SYS_MEMSTAT_H
+#define _SYS_MEMSTAT_H
+
+#include <sys/types.h>
+
+#define MSNORD 16
+
+/* As the kernel returns it; core is handed out in pages */
+struct memstat {
+    uint32_t    ms_total;       /* Pages of core managed */
+    uint32_t    ms_free;        /* Pages free */
+    uint32_t    ms_nalloc;      /* Allocations made */
+    uint32_t    ms_nfail;       /* Allocations refused */
+    uint32_t    ms_nreclaim;    /* Pages taken back from idle processes */
+    uint32_t    ms_nblk[MSNORD]; /* Free blocks of 2^k pages */
+    uint32_t    ms_nswout;      /* Processes swapped out */
+    uint32_t    ms_nswin;       /* Processes swapped in */
+    uint32_t    ms_pgout;       /* Pages written to swap */
+    uint32_t    ms_pgin;        /* Pages read from swap */
+    uint32_t    ms_nswio;       /* Swap transfers */
+};
+
+int memstat(struct memstat *ms);
+
+#endif /* _SYS_MEMSTAT_H */
@@ -10,6 +10,9 @@
 #define SYS_CLOSE   6
 #define SYS_WAIT    7
 #define SYS_CREAT   8
+#define SYS_VFORK   27
+#define SYS_SPAWN   29
+#define SYS_MEMSTAT 33
 #define SYS_GETFBINFO 39
 #define SYS_LSEEK   19
 #define SYS_EXEC    11
@@ -79,5 +82,21 @@
 #define SYS_SIGPENDING 103
 #define SYS_SIGRETURN 104
 #define SYS_MPROTECT 105
+#define SYS_READDIRPLUS 40
+#define SYS_COPY_FILE_RANGE 124
+#define SYS_FALLOCATE 136
+#define SYS_FADVISE 140
+#define SYS_GETDENTS 128
+#define SYS_FDATASYNC 207
+#define SYS_PREAD 281
+#define SYS_PREADV 283
+#define SYS_PWRITE 290
+#define SYS_PWRITEV 292
+#define SYS_READAHEAD 295
+#define SYS_READV 298
+#define SYS_SENDFILE 323
+#define SYS_SPLICE 355
+#define SYS_TEE 368
+#define SYS_WRITEV 398
 
 #endif /* _SYS_SYSCALL_H */
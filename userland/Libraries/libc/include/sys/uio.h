@@ -0,0 +1,20 @@
+/* sys/uio.h - Vectored I/O */
+
+#ifndef _SYS_UIO_H
+#define _SYS_UIO_H
+
+#include <sys/types.h>
+
+#define IOV_MAX 16              /* Most segments one call takes */
+
+struct iovec {
+    void   *iov_base;       /* Start of the segment */
+    size_t  iov_len;        /* Its length in bytes */
+};
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+#endif /* _SYS_UIO_H */
@@ -7,6 +7,7 @@
 
 /* Process control */
 pid_t fork(void);
+pid_t vfork(void) __attribute__((returns_twice));
 int exec(const char *filename, char *const argv[]);
 int execv(const char *filename, char *const argv[]);
 int execve(const char *filename, char *const argv[], char *const envp[]);
@@ -21,6 +22,8 @@ pid_t getppid(void);
 int close(int fd);
 ssize_t read(int fd, void *buf, size_t count);
 ssize_t write(int fd, const void *buf, size_t count);
+ssize_t pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
 off_t lseek(int fd, off_t offset, int whence);
 int dup(int oldfd);
 int dup2(int oldfd, int newfd);
@@ -28,8 +31,12 @@ int pipe(int fd[2]);
 int access(const char *pathname, int mode);
 int isatty(int fd);
 int fsync(int fd);
+int fdatasync(int fd);
 int truncate(const char *path, off_t length);
 int ftruncate(int fd, off_t length);
+ssize_t copy_file_range(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+                        size_t len, unsigned int flags);
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
 
 /* File metadata */
 
@@ -5,11 +5,21 @@
 #include <fcntl.h>
 #include <string.h>
 #include <dirent.h>
+#include <sys/stat.h>
 
-/* Unix V6 on-disk directory entry structure */
-struct v6_direct {
-    unsigned short d_ino;     /* Inode number (2 bytes) */
-    char d_name[14];          /* Filename (14 bytes) */
+/*
+ * Record returned by getdents (see kernel include/filsys.h).
+ * The kernel decodes the directory, whatever its format on
+ * disk, and returns only live entries.  readdirplus records
+ * start with a struct stat, and d_reclen covers both.
+ */
+struct k_dirent {
+    unsigned int d_ino;       /* Inode number */
+    unsigned int d_off;       /* Offset of the next entry */
+    unsigned short d_reclen;  /* Bytes to the next record */
+    unsigned char d_namlen;   /* Length of d_name */
+    unsigned char d_type;     /* DT_* file type */
+    char d_name[1];           /* Name, NUL terminated */
 };
 
 /* O_DIRECTORY might not be defined in V6 headers yet */
@@ -31,63 +41,76 @@ DIR *opendir(const char *name) {
     dirp->fd = fd;
     dirp->buf_pos = 0;
     dirp->buf_len = 0;
+    dirp->loc = 0;
+    dirp->plus = 0;
     
     return dirp;
 }
 
+/* Return the next record, refilling the buffer in the wanted form */
+static char *dir_next(DIR *dirp, int plus) {
+    char *rec;
+    
+    if (dirp->plus != plus) {
+        /* Records of the other form are read again from here */
+        seekdir(dirp, dirp->loc);
+        dirp->plus = plus;
+    }
+    if (dirp->buf_pos >= dirp->buf_len) {
+        if (plus)
+            dirp->buf_len = getdentsplus(dirp->fd, dirp->buf, sizeof(dirp->buf));
+        else
+            dirp->buf_len = getdents(dirp->fd, dirp->buf, sizeof(dirp->buf));
+        dirp->buf_pos = 0;
+        if (dirp->buf_len <= 0) {
+            dirp->buf_len = 0;
+            return NULL;
+        }
+    }
+    
+    rec = dirp->buf + dirp->buf_pos;
+    dirp->buf_pos += ((struct k_dirent *)(rec + (plus ? sizeof(struct stat) : 0)))->d_reclen;
+    return rec;
+}
+
+/* Fill in the dirent from a kernel record */
+static struct dirent *dir_entry(DIR *dirp, struct k_dirent *entry) {
+    dirp->loc = entry->d_off;
+    
+    dirp->entry.d_ino = entry->d_ino;
+    dirp->entry.d_off = entry->d_off;
+    dirp->entry.d_reclen = sizeof(struct dirent);
+    dirp->entry.d_type = entry->d_type;
+    memcpy(dirp->entry.d_name, entry->d_name, entry->d_namlen);
+    dirp->entry.d_name[entry->d_namlen] = '\0';
+    
+    return &dirp->entry;
+}
+
 struct dirent *readdir(DIR *dirp) {
+    char *rec;
+    
     if (!dirp)
         return NULL;
     
-    struct v6_direct *entry;
-    
-    while (1) {
-        /* If buffer needs refilling */
-        if (dirp->buf_pos >= dirp->buf_len) {
-            /* Read chunks of V6 entries into the buffer */
-            /* We treat dirp->buf as raw bytes from disk */
-            dirp->buf_len = read(dirp->fd, dirp->buf, sizeof(dirp->buf));
-            if (dirp->buf_len <= 0)
-                return NULL;
-            dirp->buf_pos = 0;
-            
-            /* Ensure we read a multiple of entry size */
-            /* If not, ignore partial entry at end? Or handle it?
-             * Standard read usually returns block aligned. */
-        }
-        
-        /* Check boundary for safety */
-        if ((dirp->buf_pos + sizeof(struct v6_direct)) > (unsigned int)dirp->buf_len) {
-            /* Remaining bytes not enough for an entry? Unlikely if block aligned.
-             * Force read next block. */
-             dirp->buf_pos = dirp->buf_len;
-             continue;
-        }
+    rec = dir_next(dirp, 0);
+    if (!rec)
+        return NULL;
+    return dir_entry(dirp, (struct k_dirent *)rec);
+}
 
-        /* Get next V6 entry pointer */
-        entry = (struct v6_direct *)(dirp->buf + dirp->buf_pos);
-        dirp->buf_pos += sizeof(struct v6_direct);
-        
-        /* Skip deleted entries (inode 0) */
-        if (entry->d_ino == 0)
-            continue;
-            
-        /* Convert V6 entry to POSIX dirent */
-        dirp->entry.d_ino = entry->d_ino;
-        dirp->entry.d_off = 0; /* TODO: Maintain offsets? */
-        dirp->entry.d_reclen = sizeof(struct dirent);
-        dirp->entry.d_type = DT_UNKNOWN; /* V6 doesn't store type in dir */
-        
-        /* Copy name (up to 14 chars, might not be null-terminated in V6 if full) */
-        int i;
-        for (i = 0; i < 14; i++) {
-            if (entry->d_name[i] == '\0') break;
-            dirp->entry.d_name[i] = entry->d_name[i];
-        }
-        dirp->entry.d_name[i] = '\0';
-        
-        return &dirp->entry;
-    }
+struct dirent *readdirplus(DIR *dirp, struct stat *st) {
+    char *rec;
+    
+    if (!dirp)
+        return NULL;
+    
+    rec = dir_next(dirp, 1);
+    if (!rec)
+        return NULL;
+    if (st)
+        memcpy(st, rec, sizeof(struct stat));
+    return dir_entry(dirp, (struct k_dirent *)(rec + sizeof(struct stat)));
 }
 
 int closedir(DIR *dirp) {
@@ -100,22 +123,18 @@ int closedir(DIR *dirp) {
 }
 
 void rewinddir(DIR *dirp) {
-    if (dirp) {
-        lseek(dirp->fd, 0, SEEK_SET);
-        dirp->buf_pos = 0;
-        dirp->buf_len = 0;
-    }
+    seekdir(dirp, 0);
 }
 
 long telldir(DIR *dirp) {
     if (!dirp) return -1;
-    /* This is approximate since we buffer */
-    return lseek(dirp->fd, 0, SEEK_CUR) - dirp->buf_len + dirp->buf_pos;
+    return dirp->loc;
 }
 
 void seekdir(DIR *dirp, long loc) {
     if (dirp) {
-        lseek(dirp->fd, loc, SEEK_SET);
+        /* Any offset telldir returned is where getdents can resume */
+        dirp->loc = lseek(dirp->fd, loc, SEEK_SET);
         dirp->buf_pos = 0; /* Invalidate buffer */
         dirp->buf_len = 0;
     }
@@ -43,6 +43,8 @@ static const char *error_messages[] = {
     "Broken pipe",                      /* 32 EPIPE */
     "Numerical argument out of domain", /* 33 EDOM */
     "Numerical result out of range",    /* 34 ERANGE */
+    "Resource deadlock avoided",        /* 35 EDEADLK */
+    "File name too long",               /* 36 ENAMETOOLONG */
 };
 
 #define NUM_ERRORS (sizeof(error_messages) / sizeof(error_messages[0]))
@@ -0,0 +1,110 @@
+/* spawn.c - posix_spawn over the spawn system call */
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <spawn.h>
+
+/* Action types (see kernel include/user.h) */
+#define SPAWN_CLOSE 1
+#define SPAWN_DUP2  2
+#define SPAWN_OPEN  3
+#define SPAWN_CREAT 4
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa) {
+    fa->nact = 0;
+    return 0;
+}
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa) {
+    fa->nact = 0;
+    return 0;
+}
+
+static int addact(posix_spawn_file_actions_t *fa, int type, int fd, int arg, const char *path) {
+    struct spawn_action *sa;
+
+    if (fd < 0) {
+        return EINVAL;
+    }
+    if (fa->nact >= SPAWN_MAXACT) {
+        return ENOMEM;
+    }
+    sa = &fa->act[fa->nact++];
+    sa->sa_type = type;
+    sa->sa_fd = fd;
+    sa->sa_arg = arg;
+    sa->sa_path = path;
+    return 0;
+}
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd) {
+    return addact(fa, SPAWN_CLOSE, fd, 0, NULL);
+}
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa, int fd, int newfd) {
+    if (newfd < 0) {
+        return EINVAL;
+    }
+    return addact(fa, SPAWN_DUP2, fd, newfd, NULL);
+}
+
+/*
+ * The path is not copied and must stay valid until the
+ * spawn.  The kernel only opens by access mode or creats,
+ * so O_CREAT must come as creat does it, with O_WRONLY and
+ * O_TRUNC; any other flag is refused with EINVAL.
+ */
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *fa, int fd,
+                                     const char *path, int oflag, mode_t mode) {
+    if (oflag == (O_WRONLY | O_CREAT | O_TRUNC)) {
+        return addact(fa, SPAWN_CREAT, fd, mode, path);
+    }
+    if ((oflag & ~3) != 0 || (oflag & 3) == 3) {
+        return EINVAL;
+    }
+    return addact(fa, SPAWN_OPEN, fd, oflag, path);
+}
+
+/*
+ * posix_spawn - The kernel builds the child and execs path
+ * in it directly; nothing of ours is copied.  Returns 0 or
+ * an error number.  envp is ignored, as by execve.
+ */
+int posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *fa,
+                const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]) {
+    int p;
+
+    (void)envp;
+    if (attrp != NULL) {
+        return EINVAL;
+    }
+    p = spawn(path, argv, fa ? fa->act : NULL, fa ? fa->nact : 0);
+    if (p < 0) {
+        return errno;
+    }
+    if (pid != NULL) {
+        *pid = p;
+    }
+    return 0;
+}
+
+/*
+ * posix_spawnp - As posix_spawn, but a file without a slash
+ * is looked for in /bin and then the current directory.
+ */
+int posix_spawnp(pid_t *pid, const char *file, const posix_spawn_file_actions_t *fa,
+                 const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]) {
+    char path[64];
+    int err;
+
+    if (strchr(file, '/') == NULL && strlen(file) < sizeof(path) - 5) {
+        strcpy(path, "/bin/");
+        strcat(path, file);
+        err = posix_spawn(pid, path, fa, attrp, argv, envp);
+        if (err != ENOENT) {
+            return err;
+        }
+    }
+    return posix_spawn(pid, file, fa, attrp, argv, envp);
+}
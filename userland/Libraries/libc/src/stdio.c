@@ -1,12 +1,14 @@
 /* stdio.c - POSIX standard I/O functions */
 #include <stddef.h>
 #include <stdarg.h>
+#include <sys/uio.h>
 
 extern int read(int fd, void *buf, int count);
 extern int write(int fd, const void *buf, int count);
 extern int open(const char *path, int mode);
 extern int close(int fd);
 extern long lseek(int fd, long offset, int whence);
+extern int writev(int fd, const struct iovec *iov, int iovcnt);
 extern size_t strlen(const char *s);
 
 /* File structure */
@@ -37,6 +39,7 @@ typedef struct {
 
 /* Forward declaration - after FILE is defined */
 int fflush(FILE *stream);
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream);
 
 static FILE file_table[FOPEN_MAX];
 static FILE stdin_file = {0, _FILE_READ, -1, 0, {0}, 0, 0};
@@ -176,10 +179,10 @@ char *fgets(char *s, int size, FILE *stream) {
 }
 
 int fputs(const char *s, FILE *stream) {
-    while (*s) {
-        if (fputc(*s++, stream) == EOF)
-            return EOF;
-    }
+    size_t len = strlen(s);
+
+    if (len > 0 && fwrite(s, 1, len, stream) != len)
+        return EOF;
     return 0;
 }
 
@@ -199,10 +202,49 @@ size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
     return count / size;
 }
 
+/*
+ * Write out what is buffered and then len bytes at p with
+ * one writev.  Returns the bytes of p written, or -1.
+ */
+static int flushwrite(FILE *stream, const char *p, int len) {
+    struct iovec iov[2];
+    int n, i;
+
+    iov[0].iov_base = stream->buffer;
+    iov[0].iov_len = stream->buf_len;
+    iov[1].iov_base = (void *)p;
+    iov[1].iov_len = len;
+    n = writev(stream->fd, iov, 2);
+    if (n < 0) {
+        stream->flags |= _FILE_ERR;
+        return -1;
+    }
+    if (n < stream->buf_len) {
+        for (i = n; i < stream->buf_len; i++)
+            stream->buffer[i - n] = stream->buffer[i];
+        stream->buf_len -= n;
+        return 0;
+    }
+    n -= stream->buf_len;
+    stream->buf_len = 0;
+    stream->buf_pos = 0;
+    return n;
+}
+
 size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
     const char *p = ptr;
     size_t total = size * nmemb;
     size_t count = 0;
+    int n;
+    
+    if (total == 0 || !stream || !(stream->flags & _FILE_WRITE))
+        return 0;
+    
+    /* Unbuffered, or more than the buffer holds: one system call */
+    if ((stream->flags & _FILE_UNBUF) || stream->buf_len + total > BUFSIZ) {
+        n = flushwrite(stream, p, total);
+        return n < 0 ? 0 : n / size;
+    }
     
     for (size_t i = 0; i < total; i++) {
         if (fputc(p[i], stream) == EOF)
@@ -61,6 +61,21 @@ static long syscall3(long num, long a1, long a2, long a3) {
     return ret;
 }
 
+static long syscall4(long num, long a1, long a2, long a3, long a4) {
+    long ret;
+    unsigned char err;
+    register long r_si asm("esi") = a4;
+    asm volatile ("int $0x80; setc %1"
+                  : "=a" (ret), "=q" (err)
+                  : "0" (num), "b" (a1), "c" (a2), "d" (a3), "r" (r_si)
+                  : "cc", "memory");
+    if (err) {
+        errno = (int)ret;
+        return -1;
+    }
+    return ret;
+}
+
 static long syscall5(long num, long a1, long a2, long a3, long a4, long a5) {
     long ret;
     unsigned char err;
@@ -98,6 +113,35 @@ int fork(void) {
     return (int)syscall0(SYS_FORK);
 }
 
+/*
+ * vfork - The child runs on our stack until it execs or
+ * exits and will overwrite the return address, so keep it
+ * in ECX across the trap instead.
+ */
+#define VFORK_STR(x) #x
+#define VFORK_NUM(x) VFORK_STR(x)
+__asm__(
+    ".text\n"
+    ".globl vfork\n"
+    ".type vfork, @function\n"
+    "vfork:\n\t"
+    "popl %ecx\n\t"
+    "movl $" VFORK_NUM(SYS_VFORK) ", %eax\n\t"
+    "int $0x80\n\t"
+    "jnc 1f\n\t"
+    "movl %eax, errno\n\t"
+    "movl $-1, %eax\n"
+    "1:\n\t"
+    "jmp *%ecx\n");
+
+int memstat(void *ms) {
+    return (int)syscall1(SYS_MEMSTAT, (long)ms);
+}
+
+int spawn(const char *path, char *const argv[], const void *acts, int nacts) {
+    return (int)syscall4(SYS_SPAWN, (long)path, (long)argv, (long)acts, nacts);
+}
+
 int exec(const char *filename, char *const argv[]) {
     return (int)syscall2(SYS_EXEC, (long)filename, (long)argv);
 }
@@ -221,10 +265,86 @@ int ftruncate(int fd, int length) {
     return (int)syscall2(SYS_FTRUNCATE, fd, length);
 }
 
+int pread(int fd, void *buf, int count, int offset) {
+    return (int)syscall4(SYS_PREAD, fd, (long)buf, count, offset);
+}
+
+int pwrite(int fd, const void *buf, int count, int offset) {
+    return (int)syscall4(SYS_PWRITE, fd, (long)buf, count, offset);
+}
+
+int readv(int fd, const void *iov, int iovcnt) {
+    return (int)syscall3(SYS_READV, fd, (long)iov, iovcnt);
+}
+
+int writev(int fd, const void *iov, int iovcnt) {
+    return (int)syscall3(SYS_WRITEV, fd, (long)iov, iovcnt);
+}
+
+int preadv(int fd, const void *iov, int iovcnt, int offset) {
+    return (int)syscall4(SYS_PREADV, fd, (long)iov, iovcnt, offset);
+}
+
+int pwritev(int fd, const void *iov, int iovcnt, int offset) {
+    return (int)syscall4(SYS_PWRITEV, fd, (long)iov, iovcnt, offset);
+}
+
 int fsync(int fd) {
     return (int)syscall1(SYS_FSYNC, fd);
 }
 
+int fdatasync(int fd) {
+    return (int)syscall1(SYS_FDATASYNC, fd);
+}
+
+int copy_file_range(int fd_in, int *off_in, int fd_out, int *off_out,
+                    int len, unsigned int flags) {
+    return (int)syscall6(SYS_COPY_FILE_RANGE, fd_in, (long)off_in,
+                         fd_out, (long)off_out, len, flags);
+}
+
+int splice(int fd_in, int *off_in, int fd_out, int *off_out,
+           int len, unsigned int flags) {
+    return (int)syscall6(SYS_SPLICE, fd_in, (long)off_in,
+                         fd_out, (long)off_out, len, flags);
+}
+
+int tee(int fd_in, int fd_out, int len, unsigned int flags) {
+    return (int)syscall4(SYS_TEE, fd_in, fd_out, len, flags);
+}
+
+int sendfile(int out_fd, int in_fd, int *offset, int count) {
+    return (int)syscall4(SYS_SENDFILE, out_fd, in_fd, (long)offset, count);
+}
+
+int fallocate(int fd, int mode, int offset, int len) {
+    return (int)syscall4(SYS_FALLOCATE, fd, mode, offset, len);
+}
+
+int posix_fallocate(int fd, int offset, int len) {
+    if (syscall4(SYS_FALLOCATE, fd, 0, offset, len) < 0)
+        return errno;
+    return 0;
+}
+
+int posix_fadvise(int fd, int offset, int len, int advice) {
+    if (syscall4(SYS_FADVISE, fd, offset, len, advice) < 0)
+        return errno;
+    return 0;
+}
+
+int readahead(int fd, int offset, int count) {
+    return (int)syscall3(SYS_READAHEAD, fd, offset, count);
+}
+
+int getdents(int fd, char *buf, int count) {
+    return (int)syscall3(SYS_GETDENTS, fd, (long)buf, count);
+}
+
+int getdentsplus(int fd, char *buf, int count) {
+    return (int)syscall3(SYS_READDIRPLUS, fd, (long)buf, count);
+}
+
 int utime(const char *path, void *times) {
     return (int)syscall2(SYS_UTIME, (long)path, (long)times);
 }
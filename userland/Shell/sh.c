@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <unistd.h>
+#include <spawn.h>
 
 #define BUF_SIZE 128
 #define MAX_ARGS 8
@@ -27,7 +28,7 @@ static int tokenize(char *buf, char **argv, int max_args) {
 int main(int argc, char **argv) {
     char buf[BUF_SIZE];
     char *args[MAX_ARGS];
-    int pid;
+    pid_t pid;
 
     (void)argc;
     (void)argv;
@@ -74,30 +75,11 @@ int main(int argc, char **argv) {
             continue;
         }
 
-        pid = fork();
-        if (pid == 0) {
-            char path[64];
-            if (args[0][0] == '/') {
-                execv(args[0], args);
-            } else {
-                int i = 0;
-                const char *prefix = "/bin/";
-                while (prefix[i]) {
-                    path[i] = prefix[i];
-                    i++;
-                }
-                int j = 0;
-                while (args[0][j] && i < (int)sizeof(path) - 1) {
-                    path[i++] = args[0][j++];
-                }
-                path[i] = '\0';
-                execv(path, args);
-            }
+        if (posix_spawnp(&pid, args[0], NULL, NULL, args, NULL) != 0) {
             write(1, "command not found\n", 18);
-            _exit(1);
+        } else {
+            waitpid(pid, 0, 0);
         }
-
-        wait(0);
         write(1, "$ ", 2);
     }
     return 0;
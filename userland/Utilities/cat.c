@@ -14,6 +14,17 @@ static void write_str(const char *s) {
 static void cat_fd(int fd) {
     char buf[128];
     int n;
+
+    /* Let the kernel move a file, or a pipe, without copying it here */
+    while ((n = sendfile(1, fd, NULL, 1 << 20)) > 0)
+        ;
+    if (n == 0)
+        return;
+    while ((n = splice(fd, NULL, 1, NULL, 1 << 20, 0)) > 0)
+        ;
+    if (n == 0)
+        return;
+
     while ((n = read(fd, buf, sizeof(buf))) > 0) {
         write(1, buf, n);
     }
@@ -5,11 +5,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-
-struct v6_direct {
-    ino_t d_ino;
-    char d_name[14];
-};
+#include <dirent.h>
 
 int flag_long = 0;
 
@@ -30,27 +26,20 @@ void print_mode(mode_t m) {
     putchar(m & (S_IEXEC >> 6) ? 'x' : '-');
 }
 
-void list_file(const char *path, const char *name) {
-    struct stat st;
-    if (stat(path, &st) < 0) {
-        printf("ls: cannot stat %s\n", name);
-        return;
-    }
-    
+void print_file(const struct stat *st, const char *name) {
     if (flag_long) {
-        print_mode(st.st_mode);
+        print_mode(st->st_mode);
         printf(" %2d %4d %4d %6ld %ld %s\n", 
-            st.st_nlink, st.st_uid, st.st_gid, (long)st.st_size, (long)st.st_mtime, name);
+            st->st_nlink, st->st_uid, st->st_gid, (long)st->st_size, (long)st->st_mtime, name);
     } else {
         printf("%s\n", name);
     }
 }
 
 void list_dir(const char *path) {
-    int fd;
-    struct v6_direct ent;
+    DIR *dirp;
+    struct dirent *ent;
     struct stat st;
-    char fullpath[512];
     
     if (stat(path, &st) < 0) {
         printf("ls: cannot access %s\n", path);
@@ -58,36 +47,25 @@ void list_dir(const char *path) {
     }
     
     if (!S_ISDIR(st.st_mode)) {
-        list_file(path, path);
+        print_file(&st, path);
         return;
     }
 
-    fd = open(path, O_RDONLY);
-    if (fd < 0) {
+    dirp = opendir(path);
+    if (dirp == NULL) {
         printf("ls: cannot open %s\n", path);
         return;
     }
 
-    while (read(fd, &ent, sizeof(ent)) == sizeof(ent)) {
-        if (ent.d_ino == 0) continue;
-        
-        char name[15];
-        int i;
-        for (i = 0; i < 14; i++) name[i] = ent.d_name[i];
-        name[14] = '\0';
-        
-        if (flag_long) {
-             if (strcmp(path, "/") == 0) {
-                 snprintf(fullpath, sizeof(fullpath), "/%s", name);
-             } else {
-                 snprintf(fullpath, sizeof(fullpath), "%s/%s", path, name);
-             }
-             list_file(fullpath, name);
-        } else {
-            printf("%s\n", name);
-        }
+    /* The status comes with each entry, no stat per name */
+    if (flag_long) {
+        while ((ent = readdirplus(dirp, &st)) != NULL)
+            print_file(&st, ent->d_name);
+    } else {
+        while ((ent = readdir(dirp)) != NULL)
+            printf("%s\n", ent->d_name);
     }
-    close(fd);
+    closedir(dirp);
 }
 
 int main(int argc, char **argv) {